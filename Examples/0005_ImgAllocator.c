@@ -16,7 +16,7 @@ typedef struct {
 
 Wnd wnd;
 Ent* ents;
-unsigned elapsed;
+Rng rng;
 int frames, fps;
 float fpsTimer;
 Ft ft;
@@ -27,12 +27,11 @@ void MkEnt() {
   Ent* ent = ArrAlloc(&ents, 1);
   int* pixs = 0;
   int i;
-  /* pseudorandom */
-  int width = 20 + (elapsed & 31);
-  int height = 20 + ((elapsed >> 5) & 31);
-  int col = 0x404040 + (elapsed & 0x5f5f5f);
-  float vx = (0xfff + (elapsed & 0xffff)) / (float)(0xffff) * 400;
-  float vy = (0xfff + ((elapsed >> 16) & 0xffff)) / (float)(0xffff) * 400;
+  int width = RngRange(rng, 20, 52);
+  int height = RngRange(rng, 20, 52);
+  int col = 0x404040 + (RngI32(rng) & 0x5f5f5f);
+  float vx = RngFltRange(rng, 25, 425);
+  float vy = RngFltRange(rng, 25, 425);
   for (i = 0; i < width * height; ++i) {
     float roff = (i % width) / (float)width;
     float goff = (i / width) / (float)height;
@@ -128,6 +127,7 @@ void PutStatsText() {
 void Init() {
   wnd = AppWnd();
   ft = DefFt();
+  rng = MkRng(0x5eed);
   text = MkMesh();
   Col(text, 0xbebebe);
   FtMesh(text, ft, 10, 10, "space to spawn random quads\nbackspace to free the oldest quad\n"
@@ -137,6 +137,7 @@ void Init() {
 void Quit() {
   RmEnts();
   RmMesh(text);
+  RmRng(rng);
 }
 
 void KeyDown() {
@@ -169,8 +170,6 @@ void Frame() {
   PutMesh(text, 0, FtImg(ft));
   PutStatsText();
 
-  elapsed += (int)(Delta() * 1000000000);
-
   ++frames;
   fpsTimer += Delta();
   while (fpsTimer >= 1) {
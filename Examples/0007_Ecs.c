@@ -62,40 +62,9 @@ void ArrNot(int** dst, int* arr) {
   }
 }
 
-/* find first bit that is equal to bit (either 1 or 0) */
-int ArrBitScan(int* arr, int bit) {
-  int i, j;
-  for (i = 0; i < ArrLen(arr); ++i) {
-    for (j = 0; j < 32; ++j) {
-      if ((arr[i] & (1 << j)) == (bit << j)) {
-        return i * 32 + j;
-      }
-    }
-  }
-  return -1;
-}
-
-/* count number of bits that are equal to bit (either 1 or 0) */
-int ArrBitCount(int* arr, int bit) {
-  int i, j, res = 0;
-  for (i = 0; i < ArrLen(arr); ++i) {
-    for (j = 0; j < 32; ++j) {
-      if ((arr[i] & (1 << j)) == (bit << j)) {
-        res += 1;
-      }
-    }
-  }
-  return res;
-}
-
 /* returns non-zero if (arr & bits) == bits */
 int ArrHasBits(int* arr, int* bits) {
-  int* and = 0;
-  int res;
-  ArrAnd(&and, arr, bits);
-  res = ArrMemCmp(and, bits);
-  RmArr(and);
-  return res == 0;
+  return BitsContains(arr, bits);
 }
 
 /* ---------------------------------------------------------------------------------------------- */
@@ -170,7 +139,8 @@ static int* CompsToMask(int* comps) {
 /* convert a string such as Comp1|Comp2 into an arr of Comp id's. spaces are ignored.
  * invalid comps are silently ignored */
 static int* CompsStrToArr(char* s) {
-  char* name = 0;
+  char nameBuf[64]; /* comp names are short, this avoids heap allocs unless they're very long */
+  char* name = MkBufArr(nameBuf, sizeof(nameBuf), 1);
   int* comps = 0;
   int parsing = 1;
   for (; parsing; ++s) {
@@ -282,17 +252,17 @@ static EcsBucket* GetEcsBucket(int* mask) {
 
 static int EcsBucketCap(EcsBucket* bucket) {
   if (bucket) {
-    return bucket->compsLen ? ArrCap(bucket->data) / bucket->compsLen : 0;
+    return bucket->compsLen ? ArrLen(bucket->data) / bucket->compsLen : 0;
   }
   return 0;
 }
 
 static int EcsBucketOccupancy(EcsBucket* bucket) {
-  return ArrBitCount(bucket->occupied, 1);
+  return BitsCount(bucket->occupied);
 }
 
 static int EcsBucketOccupied(EcsBucket* bucket, int index) {
-  return bucket->occupied[index / 32] & (1 << (index % 32));
+  return BitsTest(bucket->occupied, index);
 }
 
 static void* GetCompsInternal(EcsBucket* bucket, int compId) {
@@ -361,13 +331,11 @@ static int EcsBucketAlloc(int* mask) {
     }
     RmArr(data);
     bucket->data = data = newData;
-    while (ArrLen(bucket->occupied) < newCap) {
-      ArrCat(&bucket->occupied, 0);
-    }
+    BitsResize(&bucket->occupied, newCap);
     cap = newCap;
   }
-  index = ArrBitScan(bucket->occupied, 0);
-  bucket->occupied[index / 32] |= 1 << (index % 32);
+  index = BitsScanClr(bucket->occupied, 0);
+  BitsSet(bucket->occupied, index);
   for (i = 0; i < ArrLen(comps); ++i) {
     Comp* comp = CompById(comps[i]);
     MemSet(GetCompInternal(bucket, comp->id, index), 0, comp->len);
@@ -378,7 +346,7 @@ static int EcsBucketAlloc(int* mask) {
 void RmEnt(Ent ent) {
   HandleComp* handle = EntHandle(ent);
   EcsBucket* bucket = GetEcsBucket(handle->mask);
-  bucket->occupied[handle->index / 32] &= ~(1 << (handle->index % 32));
+  BitsClr(bucket->occupied, handle->index);
 }
 
 static Ent MkEntHandle(int* mask, int index) {
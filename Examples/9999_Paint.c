@@ -67,7 +67,7 @@ int* MkPixs(int fillCol, int width, int height) {
 
 void EdMapToImg(float* point) {
   /* un-trans mouse coordinates so they are relative to the img */
-  InvTransPt(ToTmpMatOrtho(trans), point);
+  TransPt(ToTmpInvMatOrtho(trans), point);
   point[0] /= scale;
   point[1] /= scale;
 }
@@ -8,6 +8,9 @@
 
 struct _OsTime { struct timespec t; };
 
+/* the core declares Sz by hand since it can't include stddef.h. fails to compile if it's wrong */
+typedef char SzIsSizeT[sizeof(Sz) == sizeof(size_t) ? 1 : -1];
+
 float FltMod(float x, float y) { return (float)fmod(x, y); }
 float Sin(float degrees) { return (float)sin(ToRad(degrees)); }
 float Cos(float degrees) { return (float)cos(ToRad(degrees)); }
@@ -24,18 +27,74 @@ static void Die(char* fmt, ...) {
   exit(1);
 }
 
-void* Alloc(int n) {
-  void* p = malloc(n);
-  MemSet(p, 0, n);
+/* the default zalloc uses calloc because big zeroed buffers such as img pages come straight from
+ * the os as lazily zero-filled pages, so we don't touch all the memory up front */
+
+static void* DefAlloc(void* user, Sz n) { return malloc(n); }
+static void* DefZAlloc(void* user, Sz n) { return calloc(1, n); }
+static void* DefRealloc(void* user, void* p, Sz n) { return realloc(p, n); }
+static void DefFree(void* user, void* p) { free(p); }
+
+static struct _Allocator {
+  AllocFunc* alloc;
+  AllocFunc* zalloc;
+  ReallocFunc* realloc;
+  FreeFunc* free;
+  void* user;
+} allocator = { DefAlloc, DefZAlloc, DefRealloc, DefFree, 0 };
+
+void SetAllocator(AllocFunc* alloc, AllocFunc* zalloc, ReallocFunc* realloc, FreeFunc* free,
+  void* user)
+{
+  if (!alloc && !zalloc && !realloc && !free) {
+    alloc = DefAlloc;
+    zalloc = DefZAlloc;
+    realloc = DefRealloc;
+    free = DefFree;
+  }
+  allocator.alloc = alloc;
+  allocator.zalloc = zalloc;
+  allocator.realloc = realloc;
+  allocator.free = free;
+  allocator.user = user;
+}
+
+void GetAllocator(AllocFunc** alloc, AllocFunc** zalloc, ReallocFunc** realloc, FreeFunc** free,
+  void** user)
+{
+  *alloc = allocator.alloc;
+  *zalloc = allocator.zalloc;
+  *realloc = allocator.realloc;
+  *free = allocator.free;
+  *user = allocator.user;
+}
+
+void* AllocSz(Sz n) {
+  void* p;
+  if (allocator.zalloc) {
+    return allocator.zalloc(allocator.user, n);
+  }
+  p = allocator.alloc(allocator.user, n);
+  if (p) {
+    memset(p, 0, n);
+  }
   return p;
 }
 
-void* Realloc(void* p, int n) {
-  return realloc(p, n);
+void* AllocRawSz(Sz n) {
+  return allocator.alloc(allocator.user, n);
 }
 
+void* ReallocSz(void* p, Sz n) {
+  return allocator.realloc(allocator.user, p, n);
+}
+
+void* Alloc(int n) { return n >= 0 ? AllocSz(n) : 0; }
+void* AllocRaw(int n) { return n >= 0 ? AllocRawSz(n) : 0; }
+void* Realloc(void* p, int n) { return n >= 0 ? ReallocSz(p, n) : 0; }
+
 void Free(void* p) {
-  free(p);
+  allocator.free(allocator.user, p);
 }
 
 void MemSet(void* p, unsigned char val, int n) {
@@ -50,28 +109,58 @@ void MemMv(void* dst, void* src, int n) {
   memmove(dst, src, n);
 }
 
-int WrFile(char* path, void* data, int dataLen) {
+Sz WrFileSz(char* path, void* data, Sz dataLen) {
   FILE* f = fopen(path, "wb");
-  int res;
+  Sz res;
   if (!f) {
-    return -1;
+    return (Sz)-1;
   }
-  res = (int)fwrite(data, 1, dataLen, f);
+  res = fwrite(data, 1, dataLen, f);
   fclose(f);
   return res;
 }
 
-int RdFile(char* path, void* data, int maxSize) {
+int WrFile(char* path, void* data, int dataLen) {
+  return dataLen >= 0 ? (int)WrFileSz(path, data, dataLen) : -1;
+}
+
+void Log(char* str) {
+  fputs(str, stderr);
+  fputc('\n', stderr);
+}
+
+Sz RdFileSz(char* path, void* data, Sz maxSize) {
   FILE* f = fopen(path, "rb");
-  int res;
+  Sz res;
   if (!f) {
-    return -1;
+    return (Sz)-1;
   }
-  res = (int)fread(data, 1, maxSize, f);
+  res = fread(data, 1, maxSize, f);
   fclose(f);
   return res;
 }
 
+int RdFile(char* path, void* data, int maxSize) {
+  return maxSize >= 0 ? (int)RdFileSz(path, data, maxSize) : -1;
+}
+
+/* ftell returns a long, which covers files past 2 GiB wherever long is 64-bit */
+Sz FileSizeSz(char* path) {
+  FILE* f = fopen(path, "rb");
+  long size;
+  if (!f) {
+    return (Sz)-1;
+  }
+  size = fseek(f, 0, SEEK_END) ? -1 : ftell(f);
+  fclose(f);
+  return size >= 0 ? (Sz)size : (Sz)-1;
+}
+
+int FileSize(char* path) {
+  Sz size = FileSizeSz(path);
+  return size <= 0x7fffffff ? (int)size : -1;
+}
+
 static OsTime MkOsTime() {
   return Alloc(sizeof(struct _OsTime));
 }
@@ -37,10 +37,23 @@ static void GrInit() {
   glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 }
 
+static Pool meshPool;
+
+/* any Mesh still alive becomes invalid */
+static void GrRm() {
+  RmPool(meshPool);
+  meshPool = 0;
+}
+
 /* ---------------------------------------------------------------------------------------------- */
 
 Mesh MkMesh() {
-  Mesh mesh = Alloc(sizeof(struct _Mesh));
+  Mesh mesh;
+  if (!meshPool) {
+    meshPool = MkPool(sizeof(struct _Mesh));
+    SetPoolName(meshPool, "Mesh");
+  }
+  mesh = PoolAlloc(meshPool);
   Col(mesh, 0xffffff);
   return mesh;
 }
@@ -50,7 +63,13 @@ void RmMesh(Mesh mesh) {
     RmArr(mesh->verts);
     RmArr(mesh->indices);
   }
-  Free(mesh);
+  PoolFree(meshPool, mesh);
+}
+
+void ClrMesh(Mesh mesh) {
+  SetArrLen(mesh->verts, 0);
+  SetArrLen(mesh->indices, 0);
+  mesh->istart = 0;
 }
 
 void Col(Mesh mesh, int color) {
@@ -183,16 +202,22 @@ Img Pixs(Img img, int width, int height, int* data) {
 }
 
 Img PixsEx(Img img, int width, int height, int* data, int stride) {
-  int* rgba = 0;
+  int mark = FrameMark();
+  int* rgba = FrameAlloc(SizeMul(SizeMul(width, height), sizeof(int)));
+  int* p = rgba;
   int x, y;
+  if (!rgba) {
+    FrameRewind(mark);
+    return img;
+  }
   for (y = 0; y < height; ++y) {
     for (x = 0; x < width; ++x) {
-      ArrCat(&rgba, COL(data[y * stride + x]));
+      *p++ = COL(data[y * stride + x]);
     }
   }
   glBindTexture(GL_TEXTURE_2D, img->handle);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
-  RmArr(rgba);
+  FrameRewind(mark); /* so flushing several pages in a row reuses the same memory */
   img->width = width;
   img->height = height;
   return img;
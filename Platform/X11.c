@@ -7,6 +7,7 @@
 
 /* render layer */
 static void GrInit();
+static void GrRm();
 
 /* os layer */
 typedef struct _OsTime* OsTime;
@@ -150,6 +151,7 @@ Wnd MkWnd(char* name, char* class) {
 }
 
 void RmWnd(Wnd wnd) {
+  GrRm();
   glXMakeCurrent(wnd->dpy, 0, 0);
   glXDestroyContext(wnd->dpy, wnd->gl);
   XDestroyWindow(wnd->dpy, wnd->ptr);
@@ -554,7 +554,7 @@ void EdUpdMesh() {
 
 void EdMapToImg(float* point) {
   /* un-mat mouse coordinates so they are relative to the img */
-  InvTransPt(ToTmpMatOrtho(trans), point);
+  TransPt(ToTmpInvMatOrtho(trans), point);
   point[0] /= scale;
   point[1] /= scale;
 }
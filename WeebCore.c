@@ -6,13 +6,22 @@ typedef int ImgPtr;
 typedef struct _Mesh* Mesh;
 typedef struct _Img* Img;
 typedef struct _Trans* Trans;
+typedef struct _TransBatch* TransBatch;
+typedef struct _TransTree* TransTree;
 typedef struct _Packer* Packer;
+typedef struct _Grid* Grid;
+typedef struct _Rng* Rng;
 typedef struct _Wnd* Wnd;
 typedef struct _Mat* Mat;
 typedef struct _Arena* Arena;
+typedef struct _Pool* Pool;
 typedef struct _Map* Map;
 typedef struct _Hash* Hash;
 
+/* unsigned byte count for data past the 2 GiB that int sizes can address, see the *Sz funcs. it's
+ * size_t on every platform WeebCore supports. declared by hand because the core includes nothing */
+typedef unsigned long Sz;
+
 /* ---------------------------------------------------------------------------------------------- */
 /*                                          APP INTERFACE                                         */
 /*                                                                                                */
@@ -52,8 +61,21 @@ void RmHandler(int msg, AppHandler handler);
 /* time elapsed since the last frame, in seconds */
 float Delta();
 
+/* allocate n bytes of scratch memory that stays valid until the end of the current frame, when
+ * AppFrame releases it all at once. there's no need to free it. memory is not initialized.
+ * this is just a pointer bump into a block that is sized to the peak usage of previous frames,
+ * so temporary allocations don't hit the heap at all */
+void* FrameAlloc(int n);
+
+/* frame memory is a stack. FrameRewind releases everything allocated since the matching
+ * FrameMark, so big temporaries can reuse the same memory within a frame. outside of the app loop,
+ * nothing is released until the next frame ends, so pair FrameAlloc with FrameMark/FrameRewind */
+int FrameMark();
+void FrameRewind(int mark);
+
 ImgPtr ImgFromSprFile(char* path);
 void PutMesh(Mesh mesh, Mat mat, ImgPtr ptr);
+void PutMeshAff(Mesh mesh, float* aff, ImgPtr ptr); /* aff can be NULL for identity */
 
 Wnd AppWnd();
 ImgPtr ImgAlloc(int width, int height);
@@ -92,6 +114,17 @@ void FloorFlts(int n, float* floats, float* result);
 void ClampFlts(int n, float* floats, float* result, float min, float max);
 void AddFlts(int n, float* a, float* b, float* result);
 
+/* fused versions that do both steps in one pass over memory */
+void LerpClampFlts(int n, float* a, float* b, float* result, float amount, float min, float max);
+void MulAddFlts(int n, float* a, float* b, float* result, float scalar); /* a * scalar + b */
+
+/* sine and cosine of deg in one call. the angle is reduced to [-45, 45] in degrees, so multiples
+ * of 90 come out exact, then evaluated with minimax polynomials. max abs error against double
+ * precision sin/cos is under 1e-7 for |deg| < 1e5, about as good as a float gets.
+ * build the core with WEEBCORE_PLATFORM_SINCOS defined to use the platform Sin/Cos instead.
+ * used by Rot and the Trans mats */
+void SinCos(float deg, float* s, float* c);
+
 /* these funcs operate on a rectangle represented as an array of 4 floats (left, top, right, bot) */
 void CpyRect(float* dst, float* src);
 void SetRect(float* rect, float left, float right, float top, float bot);
@@ -120,6 +153,14 @@ int RectInRect(float* needle, float* haystack);
 /* check that needle's area can entirely fit inside of haystack (ignores position) */
 int RectInRectArea(float* needle, float* haystack);
 
+/* batch versions of RectSect, PtInRect and RectInRect for culling and hit testing. rects is a
+ * structure of arrays: n lefts followed by n rights, n tops and n bots. bit i of outBits is set to
+ * the result for rect i, outBits must have room for n bits (see BitsResize). the whole words are
+ * overwritten, use BitsIdxs to turn the result into a list of indices */
+void RectsSectRect(float* rects, int n, float* query, int* outBits);
+void RectsContainPt(float* rects, int n, float x, float y, int* outBits);
+void RectsInRect(float* rects, int n, float* haystack, int* outBits);
+
 /* ---------------------------------------------------------------------------------------------- */
 
 /* OpenGL-like post-multiplied mat. mat memory layout is row major */
@@ -146,12 +187,64 @@ Mat MkMulMatFlt(Mat matA, float* matB);
 /* trans 2D point in place */
 void TransPt(Mat mat, float* point);
 
-/* trans 2D point in place by inverse of mat. note that this only works if the mat is orthogonal */
+/* trans 2D point in place by inverse of mat. note that this only works if the mat is orthogonal.
+ * for a Trans, TransPt with ToTmpInvMat is cheaper and works with any scale */
 void InvTransPt(Mat mat, float* point);
 
+/* trans n 2D points in place. xy is interleaved { x, y, x, y, ... }, the SoA versions take
+ * separate x and y arrays. the loops are simple enough for the compiler to vectorize, so these are
+ * much faster than calling TransPt/InvTransPt in a loop. same orthogonal rule for InvTransPts */
+void TransPts(Mat mat, float* xy, int n);
+void TransPtsSoA(Mat mat, float* xs, float* ys, int n);
+void InvTransPts(Mat mat, float* xy, int n);
+void InvTransPtsSoA(Mat mat, float* xs, float* ys, int n);
+
 /* note: this is a DIRECT pointer to the matrix data so if you modify it it will affect it */
 float* MatFlts(Mat mat);
 
+/* value versions of the Mat funcs. they work on a float[16] you provide, for example on the stack,
+ * so they never allocate. same layout and multiplication order as Mat, the Mat funcs are
+ * implemented on top of these. Scale, Pos and Rot only touch the rows they change instead of doing
+ * a full 4x4 multiply */
+void IdentMatFlts(float* m);
+void ScaleMatFlts(float* m, float x, float y);
+void PosMatFlts(float* m, float x, float y);
+void RotMatFlts(float* m, float deg);
+void MulMatFlts(float* m, float* other); /* in place, same as MulMatFlt */
+void MulMatFltsEx(float* result, float* a, float* b); /* result must not alias a or b */
+void TransPtFlts(float* m, float* point);
+void InvTransPtFlts(float* m, float* point);
+
+/* 2D affine transforms stored as 6 floats { a, b, c, d, x, y } which are the only elements of the
+ * 4x4 mat that 2D transforms ever touch (m[0], m[1], m[4], m[5], m[12], m[13]):
+ *
+ *   x' = x * a + y * c + x
+ *   y' = x * b + y * d + y
+ *
+ * same multiplication order as Mat, but a compose is 12 multiplies instead of 64 and they take
+ * 24 bytes instead of 64. convert to a 4x4 mat only when you need to submit it, see PutMeshAff */
+void IdentAff(float* aff);
+void ScaleAff(float* aff, float x, float y);
+void PosAff(float* aff, float x, float y);
+void RotAff(float* aff, float deg);
+void MulAff(float* aff, float* other); /* in place, aff = other * aff like MulMatFlt */
+void MulAffEx(float* result, float* a, float* b); /* result = b * a. must not alias a or b */
+void TransPtAff(float* aff, float* point);
+
+/* general inverse, works with any scale and skew. returns 0 and leaves result untouched if aff
+ * can't be inverted (zero scale) */
+int InvAff(float* result, float* aff);
+
+/* transform point by the inverse of aff */
+void InvTransPtAff(float* aff, float* point);
+
+/* batch versions of TransPtAff, see TransPts */
+void TransPtsAff(float* aff, float* xy, int n);
+void TransPtsAffSoA(float* aff, float* xs, float* ys, int n);
+
+void AffToMatFlts(float* m, float* aff);
+void MatFltsToAff(float* aff, float* m);
+
 /* ---------------------------------------------------------------------------------------------- */
 /*                                          WBSPR FORMAT                                          */
 /* this is meant as simple RLE compression for 2D sprites with a limited color palette            */
@@ -195,6 +288,9 @@ char* ArgbToSprArr(int* argb, int width, int height);
 /* calls PutMeshRawEx with zero u/v offset */
 void PutMeshRaw(Mesh mesh, Mat mat, Img img);
 
+/* same as PutMeshRaw but with a 2D affine transform, see IdentAff */
+void PutMeshRawAff(Mesh mesh, float* aff, Img img);
+
 /* create a mat from scale, position, origin, rot applied in a fixed order */
 
 Trans MkTrans();
@@ -226,6 +322,65 @@ Mat ToMatOrtho(Trans trans);
 Mat ToTmpMat(Trans trans);
 Mat ToTmpMatOrtho(Trans trans);
 
+/* inverse of ToTmpMat/ToTmpMatOrtho, same lifetime rules. use TransPt with these to map points
+ * such as mouse coordinates back into the space of the Trans. a zero scale maps everything to
+ * the origin */
+Mat ToTmpInvMat(Trans trans);
+Mat ToTmpInvMatOrtho(Trans trans);
+
+/* structure of arrays store for large numbers of transforms, such as thousands of sprites. each
+ * field of Trans is kept in its own float array which you write directly, then UpdTransBatch
+ * recomputes all the mats in one loop */
+TransBatch MkTransBatch();
+void RmTransBatch(TransBatch batch);
+int TransBatchLen(TransBatch batch);
+
+/* grow or shrink the batch. new transforms are cleared like ClrTrans. returns 0 and leaves the
+ * batch untouched if the allocation fails. invalidates pointers from TransBatchFlts/TransBatchMat */
+int SetTransBatchLen(TransBatch batch, int len);
+
+/* DIRECT pointer to the TransBatchLen floats of field (TRANS_X, TRANS_ROT, ...) */
+float* TransBatchFlts(TransBatch batch, int field);
+
+/* recompute the mats of the transforms whose bit is set in dirty (see BitsSet), or all of them if
+ * dirty is NULL. dirty is not modified, clear it with BitsClrAll when you're done */
+void UpdTransBatch(TransBatch batch, int* dirty);
+
+/* mat for transform i as of the last UpdTransBatch. it belongs to the batch and can be passed
+ * straight to PutMesh */
+Mat TransBatchMat(TransBatch batch, int i);
+
+/* parent/child hierarchy of Trans. each node's world mat is its own mat followed by its parent's
+ * world mat, so children move with their parents. world mats are cached and only recomputed when
+ * the Trans of the node or one of its ancestors changes.
+ *
+ * nodes are identified by the int returned by TransTreeAdd. the tree doesn't own the Trans, and a
+ * Trans should only be in one tree at a time */
+TransTree MkTransTree();
+void RmTransTree(TransTree tree);
+
+/* returns the new node, or -1 if the allocation fails or parent isn't a node in the tree. parent
+ * is -1 for a root node */
+int TransTreeAdd(TransTree tree, Trans trans, int parent);
+
+/* the node's children become root nodes. the node index can be reused by TransTreeAdd. removing a
+ * node that was already removed does nothing */
+void TransTreeRm(TransTree tree, int node);
+
+/* parent is -1 to make node a root. returns 0 and does nothing if parent isn't a node in the tree,
+ * or if it's node or one of its children, since that would make a loop */
+int SetTransTreeParent(TransTree tree, int node, int parent);
+int TransTreeParent(TransTree tree, int node);
+Trans TransTreeTrans(TransTree tree, int node);
+
+/* recompute the world mats that are out of date. nodes are kept in depth-first arrays so this is a
+ * single linear pass that never goes back up the tree */
+void UpdTransTree(TransTree tree);
+
+/* world mat for node as of the last UpdTransTree. it belongs to the tree, pass it straight to
+ * PutMesh. TransTreeAdd can invalidate it */
+Mat TransTreeMat(TransTree tree, int node);
+
 /* add a rectangle to mesh */
 void Quad(Mesh mesh, float x, float y, float width, float height);
 
@@ -327,15 +482,16 @@ char* ArrStrJoin(char** array, char* separator);
 
 #define ArrDup(arr) ArrDupEx(arr, sizeof(arr[0]))
 
-/* shorthand macro to append a single element to the array */
-#define ArrCat(pArr, x) { \
-  ArrReserve((pArr), 1); \
-  (*(pArr))[ArrLen(*(pArr))] = (x); \
-  SetArrLen(*(pArr), ArrLen(*(pArr)) + 1); \
-}
+/* shorthand macro to append a single element to the array. evaluates to the array, or NULL if the
+ * allocation fails, in which case the array is left untouched */
+#define ArrCat(pArr, x) \
+  (ArrReserve((pArr), 1) ? \
+    ((*(pArr))[ArrLen(*(pArr))] = (x), SetArrLen(*(pArr), ArrLen(*(pArr)) + 1), *(pArr)) : 0)
 
 /* reserve memory for at least numElements extra elements.
- * returns a pointer to the end of the array */
+ * returns a pointer to the end of the array, or NULL if the allocation fails. lengths and
+ * capacities are ints, so an Arr holds at most 2^31 - 1 elements, but the size in bytes can go past
+ * 2 GiB where Sz allows. the array is left untouched on failure */
 #define ArrReserve(pArr, numElements) \
   ArrReserveEx((void**)(pArr), sizeof((*pArr)[0]), numElements)
 
@@ -345,12 +501,54 @@ char* ArrStrJoin(char** array, char* separator);
 #define ArrAlloc(pArr, numElements) \
   ArrAllocEx((void**)(pArr), sizeof((*pArr)[0]), numElements)
 
-void ArrStrCat(char** pArr, char* str);
+/* append n elements copied from src with a single reserve and copy.
+ * returns a pointer to the beginning of the new elements */
+#define ArrCatN(pArr, src, n) \
+  ArrCatEx((void**)(pArr), sizeof((*pArr)[0]), src, n)
+
+/* same as ArrReserve/ArrAlloc but the element storage is aligned to align bytes, which must be a
+ * power of two (16, 32, 64 for SSE, AVX, cache lines). the alignment sticks to the array and is kept
+ * when it grows. everything else (ArrLen, ArrCat, RmArr, ...) works the same as a normal Arr.
+ * regular Arrs are already aligned to 16 bytes if the allocator returns 16-byte aligned memory */
+#define ArrReserveAligned(pArr, numElements, align) \
+  ArrReserveAlignedEx((void**)(pArr), sizeof((*pArr)[0]), numElements, align)
+
+#define ArrAllocAligned(pArr, numElements, align) \
+  ArrAllocAlignedEx((void**)(pArr), sizeof((*pArr)[0]), numElements, align)
+
+/* make an empty Arr that takes its memory from an Arena instead of the heap. growing copies it to a
+ * bigger block in the same arena. RmArr does nothing, the memory goes away with the arena, so this
+ * is ideal for temporaries combined with ArenaMark/ArenaRewind */
+void* MkArenaArr(Arena arena, int elementSize, int capacity);
+
+/* make an empty Arr that lives in buf, usually a small array on the stack. if it outgrows buf it
+ * moves to the heap like a normal Arr. always call RmArr on it in case it did.
+ * returns NULL (an empty heap Arr) if buf is too small to even hold the header */
+void* MkBufArr(void* buf, int bufSize, int elementSize);
 
 void* ArrReserveEx(void** pArr, int elementSize, int numElements);
 void* ArrAllocEx(void** pArr, int elementSize, int numElements);
+void* ArrReserveAlignedEx(void** pArr, int elementSize, int numElements, int align);
+void* ArrAllocAlignedEx(void** pArr, int elementSize, int numElements, int align);
+void* ArrCatEx(void** pArr, int elementSize, void* src, int numElements);
 void* ArrDupEx(void* array, int elementSize);
 
+/* string builder. these append text to a char Arr without a null terminator, so you can keep
+ * appending. ArrCat(&arr, 0) when you're done to use it as a null-terminated string */
+
+void ArrStrCat(char** pArr, char* str);
+void ArrStrCatN(char** pArr, char* str, int n); /* append the first n chars of str */
+
+/* converts x to a string with the specified base and appends the characters to arr.
+   base is clamped to 2-16 */
+void ArrStrCatI32(char** pArr, int x, int base);
+
+/* append x as lowercase hex, zero padded to at least minDigits digits. useful for colors */
+void ArrStrCatHex(char** pArr, int x, int minDigits);
+
+/* append x with a fixed number of decimals (clamped to 0-9). very large values use an exponent */
+void ArrStrCatFlt(char** pArr, float x, int decimals);
+
 /* ---------------------------------------------------------------------------------------------- */
 /*                                           ARENA                                                */
 /*                                                                                                */
@@ -362,14 +560,96 @@ Arena MkArena();
 Arena MkArenaEx(int chunkSize);
 void RmArena(Arena arena);
 
-/* if n is bigger than the chunk size, a new chunk at least as big as n will be allocated */
+/* if n is bigger than the chunk size, a new chunk at least as big as n will be allocated.
+ * memory is initialized to zero */
 void* ArenaAlloc(Arena arena, int n);
 void* ArenaMemDup(Arena arena, void* p, int n);
 
+/* ArenaRewind releases everything allocated after the matching ArenaMark. this can be used for
+ * scoped temporary allocations. marks taken after the one you rewind to become invalid */
+int ArenaMark(Arena arena);
+void ArenaRewind(Arena arena, int mark);
+
+/* release all allocations but keep the chunks around, so an arena can be reused for the next
+ * level/load/etc without allocating chunks again */
+void ArenaReset(Arena arena);
+
+/* stats. used is the bytes handed out (aligned to 8), waste is the bytes left unused at the end of
+ * chunks that couldn't fit the next allocation */
+int ArenaBytesUsed(Arena arena);
+int ArenaNumChunks(Arena arena);
+int ArenaWaste(Arena arena);
+
+/* ---------------------------------------------------------------------------------------------- */
+/*                                            POOL                                                */
+/*                                                                                                */
+/* allocator for lots of objects of the same size. memory comes from slabs of many elements and   */
+/* freed elements go in a free list, so alloc and free are O(1) and don't touch the heap after    */
+/* the first few slabs. the built in handles such as Mat, Trans, Mesh and Spr are pooled          */
+/* ---------------------------------------------------------------------------------------------- */
+
+Pool MkPool(int elementSize);
+Pool MkPoolEx(int elementSize, int slabLen); /* slabLen is the number of elements per slab */
+
+/* frees all the slabs. any element that hasn't been freed yet becomes invalid. in WEEBCORE_MEMDIAG
+ * builds, pools that still have live elements are logged as leaks under their name */
+void RmPool(Pool pool);
+
+/* memory is initialized to zero */
+void* PoolAlloc(Pool pool);
+void PoolFree(Pool pool, void* p);
+
+/* name for the memory diagnostics, such as "Mat". it's not copied so it must stay valid */
+void SetPoolName(Pool pool, char* name);
+
+/* number of elements that have been allocated and not freed yet */
+int PoolLive(Pool pool);
+
+/* ---------------------------------------------------------------------------------------------- */
+/*                                             BITS                                               */
+/*                                                                                                */
+/* bit arrays stored in a resizable int array, 32 bits per element. bit i is bit i % 32 of        */
+/* bits[i / 32]. scans and counts work on whole words so sparse or full masks are cheap           */
+/* ---------------------------------------------------------------------------------------------- */
+
+/* grow the array to hold at least numBits bits. new bits are cleared. never shrinks */
+void BitsResize(int** pBits, int numBits);
+
+/* i must be within the array. see BitsResize */
+void BitsSet(int* bits, int i);
+void BitsClr(int* bits, int i);
+int BitsTest(int* bits, int i);
+
+/* clear every bit without changing the size */
+void BitsClrAll(int* bits);
+
+/* index of the first set/clear bit at or after start. -1 if there's none */
+int BitsScan(int* bits, int start);
+int BitsScanClr(int* bits, int start);
+
+/* number of set bits */
+int BitsCount(int* bits);
+
+/* in-place bulk ops. src words past the end of its array count as zero. BitsOr grows dst if src is
+ * longer */
+void BitsAnd(int* dst, int* src);
+void BitsOr(int** pDst, int* src);
+void BitsAndNot(int* dst, int* src);
+
+/* non-zero if every bit set in sub is also set in bits */
+int BitsContains(int* bits, int* sub);
+
+/* append the index of every set bit to the int array *pIdxs, in order */
+void BitsIdxs(int* bits, int** pIdxs);
+
+/* single word versions. BitScan returns the index of the lowest set bit or -1 if x is zero */
+int BitScan(int x);
+int BitCount(int x);
+
 /* ---------------------------------------------------------------------------------------------- */
 /*                                             MAP                                                */
 /*                                                                                                */
-/* sparse array that maps integers to values                                                      */
+/* sparse array that maps integers or pointers to values                                          */
 /* ---------------------------------------------------------------------------------------------- */
 
 Map MkMap();
@@ -377,6 +657,22 @@ void RmMap(Map map);
 void MapSet(Map map, int key, void* val);
 void* MapGet(Map map, int key);
 
+/* map keyed by pointers, such as Mesh or Img handles. it's the same open addressing table as MkMap
+ * but hashes the full width of the key, so on 64-bit platforms it can also be used for 64-bit ids
+ * by casting them to void*.
+ *
+ * the p funcs work on any Map, but don't mix int and ptr keys in the same map */
+Map MkPtrMap();
+void MapSetp(Map map, void* key, void* val);
+void* MapGetp(Map map, void* key);
+
+/* look up n keys at once and store the results in outVals. missing keys result in a NULL val.
+ * this hashes keys in small batches and prefetches their slots before resolving them, so the
+ * cache misses overlap instead of stalling one by one. use it when looking up a lot of keys in a
+ * row on a big map */
+void MapGetMany(Map map, int* keys, int n, void** outVals);
+void MapGetManyp(Map map, void** keys, int n, void** outVals);
+
 /* return the number of collisions (keys that hashed to the same value). this is mostly used for
  * debugging and checking whether the map is operating as intended */
 int MapColls(Map map);
@@ -384,6 +680,7 @@ int MapColls(Map map);
 /* these functions can be used to iterate keys */
 int MapNumKeys(Map map);
 int MapKey(Map map, int i);
+void* MapKeyp(Map map, int i);
 
 /* ---------------------------------------------------------------------------------------------- */
 /*                                             HASH                                               */
@@ -429,6 +726,58 @@ float* Pack(Packer pak, float* rect);
 /* mark rect as a free area. this can be used to remove already packed rects */
 void PackFree(Packer pak, float* rect);
 
+/* ---------------------------------------------------------------------------------------------- */
+/*                                         SPATIAL GRID                                           */
+/*                                                                                                */
+/* spatial hash of rects on a uniform grid of square cells, for broadphase collision and queries. */
+/* ids are indices into internal arrays, so keep them small and dense like entity indices         */
+/* ---------------------------------------------------------------------------------------------- */
+
+/* cellSize should be around the size of a typical rect */
+Grid MkGrid(float cellSize);
+void RmGrid(Grid grid);
+
+/* insert rect with id, or move it if it's already in the grid. only the cells the rect leaves and
+ * enters are touched. rect is (left, right, top, bottom) like in the Rect funcs and must be
+ * normalized. rects much bigger than a cell are kept in a list that every query checks */
+void GridSet(Grid grid, int id, float* rect);
+void GridRm(Grid grid, int id);
+
+/* append the ids of the rects that intersect rect (see RectSect) or contain the point (see
+ * PtInRect) to the int array *pIds. each id is added once */
+void GridQueryRect(Grid grid, float* rect, int** pIds);
+void GridQueryPt(Grid grid, float x, float y, int** pIds);
+
+/* append every pair of intersecting rects to *pPairs as two ids, lowest first. each pair is added
+ * once */
+void GridPairs(Grid grid, int** pPairs);
+
+/* ---------------------------------------------------------------------------------------------- */
+/*                                        RANDOM NUMBERS                                          */
+/*                                                                                                */
+/* xoshiro128** generator. fast, 16 bytes of state and the same sequence for the same seed on     */
+/* every platform. each Rng has its own state so threads can each have one                        */
+/* ---------------------------------------------------------------------------------------------- */
+
+Rng MkRng(int seed);
+void RmRng(Rng rng);
+void SeedRng(Rng rng, int seed);
+
+/* uniformly distributed 32-bit int, can be negative */
+int RngI32(Rng rng);
+
+/* int in [min, max). unbiased, returns min if max <= min */
+int RngRange(Rng rng, int min, int max);
+
+/* float in [0, 1) with 24 bits of randomness, and in [min, max). RngFltRange and RngFillFlts
+ * return min if max <= min */
+float RngFlt(Rng rng);
+float RngFltRange(Rng rng, float min, float max);
+
+/* fill n elements at once. much faster than calling RngI32/RngFltRange in a loop */
+void RngFillI32(Rng rng, int* dst, int n);
+void RngFillFlts(Rng rng, float* dst, int n, float min, float max);
+
 /* ---------------------------------------------------------------------------------------------- */
 /*                                   MISC UTILS AND MACROS                                        */
 /* ---------------------------------------------------------------------------------------------- */
@@ -456,6 +805,17 @@ int AlignDownToPowerOfTwo(int x, int a);
 /* return the closest multiple of a that is higher than value. a must be a power of 2 */
 int AlignUpToPowerOfTwo(int x, int a);
 
+/* overflow checked math for sizes and counts. returns -1 if any input is negative or the result
+ * doesn't fit an int. Alloc, AllocRaw, Realloc, FrameAlloc and the Arr funcs fail and return NULL
+ * on negative sizes, so a size computation that overflows fails the allocation cleanly instead of
+ * allocating a smaller block and writing past it */
+int SizeMul(int a, int b);
+int SizeAdd(int a, int b);
+
+/* same for Sz. returns (Sz)-1 on overflow, which no allocation can satisfy */
+Sz SzMul(Sz a, Sz b);
+Sz SzAdd(Sz a, Sz b);
+
 /* null-terminated string utils */
 int StrLen(char* s);
 void StrCpy(char* dst, char* src);
@@ -465,6 +825,11 @@ int StrCmp(char* a, char* b);
 int MemCmp(void* a, void* b, int n);
 void* MemDup(void* p, int n);
 
+/* MemSet, MemCpy and MemMv for blocks past 2 GiB. they call the int versions a chunk at a time */
+void MemSetSz(void* p, unsigned char val, Sz n);
+void MemCpySz(void* dst, void* src, Sz n);
+void MemMvSz(void* dst, void* src, Sz n);
+
 /* protobuf style varints. encoded in base 128. each byte contains 7 bits of the integer and the
  * msb is set if there's more. byte order is little endian */
 
@@ -487,19 +852,40 @@ char* ArrFromB64(char* b64Data);
 
 int HashStr(void* data, int len);
 int HashI32(int x);
-
-/* converts x to a string with the specified base and appends the characters to arr.
-   base is clamped to 1-16 */
-void ArrStrCatI32(char** arr, int x, int base);
+int HashPtr(void* p);
 
 /* like ArrStrCatI32 but creates an arr on the fly and null terminates it. must be rmd with RmArr */
 char* I32ToArrStr(int x, int base);
 
+/* returns < 0 if a goes before b, > 0 if a goes after b, 0 if they are equal */
 typedef int QsortCmp(void*, void*);
 
+/* sort an array of pointers. cmp receives the pointers themselves.
+ * introsort: quicksort with median of 3 pivots, insertion sort for small ranges and a fallback to
+ * heapsort if the recursion gets too deep, so it's O(n log n) even on adversarial input */
 void Qsort(void** arr, int len, QsortCmp* cmp);
 void QsortStrs(char** strarr, int len);
 
+/* same as Qsort but sorts any array of elements of elementSize bytes in place, such as an array of
+ * structs. cmp receives pointers to the elements, like the C standard qsort */
+void QsortEx(void* base, int len, int elementSize, QsortCmp* cmp);
+
+/* stable merge sort. equal elements keep their relative order. needs a temporary buffer of half the
+ * array, if that allocation fails it falls back to a (stable) insertion sort */
+void StableSort(void** arr, int len, QsortCmp* cmp);
+void StableSortEx(void* base, int len, int elementSize, QsortCmp* cmp);
+
+/* sort an Arr of ints in ascending (signed) order with an LSD radix sort, 8 bits per pass. this
+ * is O(n) and much faster than Qsort for big arrays of keys such as render keys, ent ids, hashes.
+ * pScratch is a pointer to an int Arr used as temporary memory, it's grown as needed so you can
+ * keep it around and reuse it every frame instead of allocating.
+ * passes where all the keys have the same byte are skipped, so small ranges of keys are cheaper */
+void RadixSort(int* keys, int** pScratch);
+
+/* same as RadixSort but vals is moved along with keys, so vals[i] still belongs to keys[i] after
+ * sorting. vals must be the same length as keys. the sort is stable */
+void RadixSortPairs(int* keys, int* vals, int** pScratch);
+
 /* ---------------------------------------------------------------------------------------------- */
 /*                                      ENUMS AND CONSTANTS                                       */
 /* ---------------------------------------------------------------------------------------------- */
@@ -686,6 +1072,18 @@ enum {
   LAST_IMG_FILTER
 };
 
+/* TransBatch fields, see TransBatchFlts */
+enum {
+  TRANS_X,
+  TRANS_Y,
+  TRANS_SCALE_X,
+  TRANS_SCALE_Y,
+  TRANS_ORIG_X,
+  TRANS_ORIG_Y,
+  TRANS_ROT,
+  LAST_TRANS_FIELD
+};
+
 /* ---------------------------------------------------------------------------------------------- */
 /*                            MISC DEBUG AND SEMI-INTERNAL INTERFACES                             */
 /* ---------------------------------------------------------------------------------------------- */
@@ -719,6 +1117,14 @@ int AppMain(int argc, char* argv[]);
 /* enable debug ui for the img allocator */
 void DiagImgAlloc(int enabled);
 
+/* enable debug ui for memory usage. shows live bytes, live allocation count and peak usage for each
+ * allocation tag. tags are either a descriptive name (Arr, Arena, Pool, ImgPage, ...) or the
+ * file:line of the call site.
+ *
+ * memory tracking has a cost, so it's only compiled in when WeebCore is built with
+ * -DWEEBCORE_MEMDIAG. in that mode RmApp also logs every allocation that is still alive as a leak */
+void DiagMem(int enabled);
+
 /* ---------------------------------------------------------------------------------------------- */
 /*                                        PLATFORM LAYER                                          */
 /*                                                                                                */
@@ -760,10 +1166,37 @@ int MouseDY(Wnd wnd);
 /* allocates n bytes and initializes memory to zero */
 void* Alloc(int n);
 
+/* allocates n bytes without initializing them. use this when you are going to overwrite all of the
+ * memory anyway */
+void* AllocRaw(int n);
+
 /* reallocate p to new size n. memory that wasn't initialized is not guaranteed to be zero */
 void* Realloc(void* p, int n);
 
+/* same as Alloc, AllocRaw and Realloc for sizes past 2 GiB. the int versions call these */
+void* AllocSz(Sz n);
+void* AllocRawSz(Sz n);
+void* ReallocSz(void* p, Sz n);
+
 void Free(void* p);
+
+/* funcs for a custom allocator. user is the pointer passed to SetAllocator */
+typedef void* AllocFunc(void* user, Sz n);
+typedef void* ReallocFunc(void* user, void* p, Sz n);
+typedef void FreeFunc(void* user, void* p);
+
+/* route Alloc, AllocRaw, Realloc and Free through a custom allocator, for example a TLSF or
+ * arena allocator. alloc returns uninitialized memory and zalloc zeroed memory. zalloc can be NULL,
+ * in which case alloc + MemSet is used. pass all NULLs to restore the default allocator.
+ *
+ * memory must be freed by the allocator that allocated it, so this should be called before
+ * allocating anything, such as at the top of AppInit */
+void SetAllocator(AllocFunc* alloc, AllocFunc* zalloc, ReallocFunc* realloc, FreeFunc* free,
+  void* user);
+
+/* get the currently installed allocator, for example to wrap it */
+void GetAllocator(AllocFunc** alloc, AllocFunc** zalloc, ReallocFunc** realloc, FreeFunc** free,
+  void** user);
 void MemSet(void* p, unsigned char val, int n);
 void MemCpy(void* dst, void* src, int n);
 
@@ -776,6 +1209,17 @@ int WrFile(char* path, void* data, int dataLen);
 /* read up to maxSize bytes from disk */
 int RdFile(char* path, void* data, int maxSize);
 
+/* size of the file in bytes. -1 if it can't be opened or it's too big to fit an int */
+int FileSize(char* path);
+
+/* WrFile, RdFile and FileSize for files past 2 GiB. they return (Sz)-1 for errors */
+Sz WrFileSz(char* path, void* data, Sz dataLen);
+Sz RdFileSz(char* path, void* data, Sz maxSize);
+Sz FileSizeSz(char* path);
+
+/* write a line of text to the console or log */
+void Log(char* str);
+
 /* ---------------------------------------------------------------------------------------------- */
 /*                                         MATH FUNCTIONS                                         */
 /*                                                                                                */
@@ -805,6 +1249,10 @@ float Sqrt(float x);
 Mesh MkMesh();
 void RmMesh(Mesh mesh);
 
+/* remove all vertices and faces but keep the memory around, so a mesh can be rebuilt every frame
+ * without reallocating */
+void ClrMesh(Mesh mesh);
+
 /* change current color. color is Argb 32-bit int (0xAARRGGBB). 255 alpha = completely transparent,
  * 0 alpha = completely opaque. the default color for a mesh should be 0xffffff */
 void Col(Mesh mesh, int color);
@@ -882,21 +1330,128 @@ void ClsCol(int color);
 #define DIRTY (1<<0)
 #define ORTHO_DIRTY (1<<1)
 #define RUNNING (1<<2)
+#define PTR_KEYS (1<<3)
+#define INV_DIRTY (1<<4)
+#define INV_ORTHO_DIRTY (1<<5)
+#define TREE_DIRTY (1<<6)
+
+/* hint the cpu to start loading p into cache. no-op on compilers that don't have it */
+#if defined(__GNUC__) || defined(__clang__)
+#define Prefetch(p) __builtin_prefetch(p)
+#else
+#define Prefetch(p)
+#endif
+
+/* the *Flts loops are written so the compiler vectorizes them. on gcc/clang x86_64 each loop is
+ * also compiled for avx2 and the first call picks a version with __builtin_cpu_supports, then goes
+ * through a func pointer from there on. this doesn't need ifunc so it also works on musl. define
+ * WEEBCORE_NO_FLTS_DISPATCH to only build the plain loops.
+ *
+ * kernels are written as FltsImpl NameImpl and FltsDispatch(Name, (params), (args)) defines Name */
+#if !defined(WEEBCORE_NO_FLTS_DISPATCH) && defined(__GNUC__) && defined(__x86_64__)
+#define FltsImpl static __inline__ __attribute__((always_inline))
+
+static int HasAvx2() {
+  static int hasAvx2 = -1;
+  if (hasAvx2 < 0) {
+    __builtin_cpu_init();
+    hasAvx2 = __builtin_cpu_supports("avx2") != 0;
+  }
+  return hasAvx2;
+}
+
+#define FltsDispatch(name, params, args) \
+  static __attribute__((target("avx2"))) void name##Avx2 params { name##Impl args; } \
+  static void name##Init params; \
+  static void (*name##Func) params = name##Init; \
+  static void name##Init params { \
+    name##Func = HasAvx2() ? name##Avx2 : name##Impl; \
+    name##Func args; \
+  } \
+  void name params { name##Func args; }
+#else
+#define FltsImpl static
+#define FltsDispatch(name, params, args) void name params { name##Impl args; }
+#endif
+
+/* when memory diagnostics are enabled, every Alloc, AllocRaw and *Sz allocation in the core records
+ * its call site as the tag. the core grows memory with ReallocSz only. the *Tagged versions give a
+ * more descriptive tag to allocations in generic code such as Arr. the allocator funcs can't take
+ * the tag, so it's handed to the diag wrapper through memDiagTag for the duration of the call only.
+ * see DiagMem */
+#ifdef WEEBCORE_MEMDIAG
+static char* memDiagTag;
+
+static void* AllocSzTagged(char* tag, Sz n) {
+  void* p;
+  memDiagTag = tag;
+  p = AllocSz(n);
+  memDiagTag = 0;
+  return p;
+}
+
+static void* AllocRawSzTagged(char* tag, Sz n) {
+  void* p;
+  memDiagTag = tag;
+  p = AllocRawSz(n);
+  memDiagTag = 0;
+  return p;
+}
+
+static void* ReallocSzTagged(char* tag, void* p, Sz n) {
+  void* res;
+  memDiagTag = tag;
+  res = ReallocSz(p, n);
+  memDiagTag = 0;
+  return res;
+}
+
+static void* AllocTagged(char* tag, int n) { return n >= 0 ? AllocSzTagged(tag, n) : 0; }
+static void* AllocRawTagged(char* tag, int n) { return n >= 0 ? AllocRawSzTagged(tag, n) : 0; }
+
+#define MemDiagStr_(x) #x
+#define MemDiagStr(x) MemDiagStr_(x)
+#define MemDiagSite __FILE__ ":" MemDiagStr(__LINE__)
+#define Alloc(n) AllocTagged(MemDiagSite, n)
+#define AllocRaw(n) AllocRawTagged(MemDiagSite, n)
+#define AllocSz(n) AllocSzTagged(MemDiagSite, n)
+#define AllocRawSz(n) AllocRawSzTagged(MemDiagSite, n)
+#define ReallocSz(p, n) ReallocSzTagged(MemDiagSite, p, n)
+#else
+#define AllocTagged(tag, n) Alloc(n)
+#define AllocRawTagged(tag, n) AllocRaw(n)
+#define AllocSzTagged(tag, n) AllocSz(n)
+#define AllocRawSzTagged(tag, n) AllocRawSz(n)
+#define ReallocSzTagged(tag, p, n) ReallocSz(p, n)
+#endif
 
 /* ---------------------------------------------------------------------------------------------- */
 
+/* the header is 16 bytes so element storage keeps the allocator's 16-byte alignment.
+ * offset is the distance from the start of the allocation to the elements, it's larger than the
+ * header when the elements are aligned to more than what the allocator gives us or when there's
+ * a prefix. arena arrs store the Arena at the start of the allocation */
 typedef struct _ArrHdr {
   int capacity;
   int length;
+  unsigned short align;
+  unsigned short flags;
+  int offset;
 } ArrHdr;
 
+#define ARR_ARENA (1<<0) /* memory belongs to the Arena stored in the prefix */
+#define ARR_BUF (1<<1)   /* memory is a user buffer, moves to the heap when it grows */
+#define ARR_PREFIX 16
+
 static ArrHdr* GetArrHdr(void* array) {
   if (!array) return 0;
   return (ArrHdr*)array - 1;
 }
 
 void RmArr(void* array) {
-  Free(GetArrHdr(array));
+  if (array && !(GetArrHdr(array)->flags & (ARR_ARENA | ARR_BUF))) {
+    Free((char*)array - GetArrHdr(array)->offset);
+  }
 }
 
 int ArrLen(void* array) {
@@ -926,39 +1481,158 @@ int ArrMemCmp(void* a, void* b) {
   return MemCmp(a, b, alen);
 }
 
-void ArrStrCat(char** pArr, char* str) {
-  for (; *str; ++str) {
-    ArrCat(pArr, *str);
+/* worst case bytes needed on top of the elements */
+static int ArrOverhead(int prefix, int align) {
+  return prefix + sizeof(ArrHdr) + (align ? align - 1 : 0);
+}
+
+/* distance from p to the next multiple of align that leaves room for prefix and the header */
+static int ArrDataOffset(char* p, int align, int prefix) {
+  int misalign;
+  prefix += sizeof(ArrHdr);
+  if (!align) {
+    return prefix;
   }
+  misalign = (int)((unsigned long)(p + prefix) & (align - 1));
+  return prefix + (misalign ? align - misalign : 0);
+}
+
+/* resize to capacity. heap arrs are realloced, which might move the memory to an address with a
+ * different alignment so we might have to shift the header and elements to the new offset.
+ * arena and buffer arrs can't be resized in place so they are copied to a new block */
+static int ArrResize(void** pArr, int elementSize, int capacity, int align) {
+  ArrHdr* header = GetArrHdr(*pArr);
+  int oldOffset = header ? header->offset : 0;
+  int length = header ? header->length : 0;
+  int flags = header ? header->flags & ~ARR_BUF : 0;
+  int prefix = (flags & ARR_ARENA) ? ARR_PREFIX : 0;
+  Sz size = SzAdd(ArrOverhead(prefix, align), SzMul(elementSize, capacity));
+  Sz used = sizeof(ArrHdr) + (Sz)length * elementSize;
+  char* oldBase = header ? (char*)*pArr - oldOffset : 0;
+  char* base;
+  int offset, realloced = 0;
+  if (!header) {
+    base = AllocSzTagged("Arr", size);
+  } else if (flags & ARR_ARENA) {
+    Arena arena = *(Arena*)oldBase;
+    base = size <= 0x7fffffff ? ArenaAlloc(arena, (int)size) : 0;
+    if (base) {
+      *(Arena*)base = arena;
+    }
+  } else if (header->flags & ARR_BUF) {
+    base = AllocSzTagged("Arr", size);
+  } else {
+    base = ReallocSzTagged("Arr", oldBase, size);
+    realloced = 1;
+  }
+  if (!base) {
+    return 0;
+  }
+  offset = ArrDataOffset(base, align, prefix);
+  if (header && !realloced) {
+    MemCpySz(base + offset - sizeof(ArrHdr), header, used);
+  } else if (realloced && offset != oldOffset) {
+    MemMvSz(base + offset - sizeof(ArrHdr), base + oldOffset - sizeof(ArrHdr), used);
+  }
+  header = (ArrHdr*)(base + offset) - 1;
+  header->capacity = capacity;
+  header->align = align;
+  header->flags = flags;
+  header->offset = offset;
+  *pArr = header + 1;
+  return 1;
 }
 
-void* ArrReserveEx(void** pArr, int elementSize, int numElements) {
+void* MkArenaArr(Arena arena, int elementSize, int capacity) {
+  int size;
+  char* base;
   ArrHdr* header;
-  if (!*pArr) {
-    int capacity = RoundUpToPowerOfTwo(Max(numElements, 16));
-    header = Alloc(sizeof(ArrHdr) + elementSize * capacity);
-    header->capacity = capacity;
-    *pArr = header + 1;
-  } else {
-    int minCapacity;
-    header = GetArrHdr(*pArr);
-    minCapacity = header->length + numElements;
-    if (header->capacity < minCapacity) {
-      int newSize;
-      while (header->capacity < minCapacity) {
-        header->capacity *= 2;
-      }
-      newSize = sizeof(ArrHdr) + elementSize * header->capacity;
-      header = Realloc(header, newSize);
-      *pArr = header + 1;
+  capacity = Max(1, capacity);
+  size = SizeAdd(ArrOverhead(ARR_PREFIX, 0), SizeMul(elementSize, capacity));
+  base = ArenaAlloc(arena, size);
+  if (!base) {
+    return 0;
+  }
+  *(Arena*)base = arena;
+  header = (ArrHdr*)(base + ARR_PREFIX);
+  header->capacity = capacity;
+  header->flags = ARR_ARENA;
+  header->offset = ARR_PREFIX + sizeof(ArrHdr);
+  return header + 1;
+}
+
+void* MkBufArr(void* buf, int bufSize, int elementSize) {
+  int offset = ArrDataOffset(buf, 16, 0);
+  ArrHdr* header;
+  if (bufSize - offset < elementSize) {
+    return 0;
+  }
+  header = (ArrHdr*)((char*)buf + offset) - 1;
+  MemSet(header, 0, sizeof(ArrHdr));
+  header->capacity = (bufSize - offset) / elementSize;
+  header->flags = ARR_BUF;
+  header->offset = offset;
+  return header + 1;
+}
+
+void* ArrReserveAlignedEx(void** pArr, int elementSize, int numElements, int align) {
+  ArrHdr* header = GetArrHdr(*pArr);
+  int prefix = header && (header->flags & ARR_ARENA) ? ARR_PREFIX : 0;
+  int minCapacity = SizeAdd(ArrLen(*pArr), numElements);
+  Sz maxElements = ((Sz)-1 - ArrOverhead(prefix, Max(align, 16))) / Max(elementSize, 1);
+  int maxCapacity = maxElements < 0x7fffffff ? (int)maxElements : 0x7fffffff;
+  int capacity = header ? header->capacity : 0;
+  if (minCapacity < 0 || minCapacity > maxCapacity) {
+    return 0;
+  }
+  align = Max(align, header ? header->align : 0);
+  if (!header || capacity < minCapacity || align != header->align) {
+    /* grow by powers of two, but clamp so the size in bytes never overflows */
+    if (!header) {
+      capacity = minCapacity > maxCapacity / 2 ? maxCapacity :
+        RoundUpToPowerOfTwo(Max(minCapacity, 16));
+    }
+    while (capacity < minCapacity) {
+      capacity = capacity > maxCapacity / 2 ? maxCapacity : Max(16, capacity * 2);
     }
+    if (!ArrResize(pArr, elementSize, capacity, align)) {
+      return 0;
+    }
+  }
+  return (char*)*pArr + (Sz)ArrLen(*pArr) * elementSize;
+}
+
+void* ArrAllocAlignedEx(void** pArr, int elementSize, int numElements, int align) {
+  void* res = ArrReserveAlignedEx(pArr, elementSize, numElements, align);
+  if (res) {
+    SetArrLen(*pArr, ArrLen(*pArr) + numElements);
+  }
+  return res;
+}
+
+void* ArrReserveEx(void** pArr, int elementSize, int numElements) {
+  return ArrReserveAlignedEx(pArr, elementSize, numElements, 0);
+}
+
+/* set the length of an array to exactly len, growing it if needed. 0 if the allocation fails */
+static int FitArr(void** pArr, int elementSize, int len) {
+  int n = ArrLen(*pArr);
+  if (len < 0 || (len > n && !ArrReserveEx(pArr, elementSize, len - n))) {
+    return 0;
   }
-  return (char*)*pArr + ArrLen(*pArr) * elementSize;
+  SetArrLen(*pArr, len);
+  return 1;
 }
 
 void* ArrAllocEx(void** pArr, int elementSize, int numElements) {
-  void* res = ArrReserveEx(pArr, elementSize, numElements);
-  SetArrLen(*pArr, ArrLen(*pArr) + numElements);
+  return ArrAllocAlignedEx(pArr, elementSize, numElements, 0);
+}
+
+void* ArrCatEx(void** pArr, int elementSize, void* src, int numElements) {
+  void* res = ArrAllocEx(pArr, elementSize, numElements);
+  if (res) {
+    MemCpySz(res, src, (Sz)numElements * elementSize);
+  }
   return res;
 }
 
@@ -966,28 +1640,128 @@ void* ArrDupEx(void* array, int elementSize) {
   void* res = 0;
   ArrAllocEx(&res, elementSize, ArrLen(array));
   if (res) {
-    MemCpy(res, array, ArrLen(array) * elementSize);
+    MemCpySz(res, array, (Sz)ArrLen(array) * elementSize);
   }
   return res;
 }
 
 char* ArrStrJoin(char** array, char* separator) {
-  int i;
+  int i, len = 0, seplen = StrLen(separator);
   char* res = 0;
   for (i = 0; i < ArrLen(array); ++i) {
+    len += StrLen(array[i]);
+  }
+  ArrReserve(&res, len + Max(0, ArrLen(array) - 1) * seplen + 1);
+  for (i = 0; i < ArrLen(array); ++i) {
+    if (i) {
+      ArrStrCatN(&res, separator, seplen);
+    }
     ArrStrCat(&res, array[i]);
-    ArrStrCat(&res, separator);
   }
   ArrCat(&res, 0);
   return res;
 }
 
+void ArrStrCat(char** pArr, char* str) {
+  ArrStrCatN(pArr, str, StrLen(str));
+}
+
+void ArrStrCatN(char** pArr, char* str, int n) {
+  ArrCatN(pArr, str, n);
+}
+
+/* digits are generated backwards into a small buffer and appended in one go */
+static void ArrStrCatU32(char** pArr, unsigned x, int base, int minDigits) {
+  static char* charset = "0123456789abcdef";
+  char buf[32];
+  char* p = buf + sizeof(buf);
+  minDigits = Min((int)sizeof(buf), minDigits);
+  do {
+    *--p = charset[x % base];
+    x /= base;
+  } while (x);
+  while (buf + sizeof(buf) - p < minDigits) {
+    *--p = '0';
+  }
+  ArrStrCatN(pArr, p, buf + sizeof(buf) - p);
+}
+
+void ArrStrCatI32(char** pArr, int x, int base) {
+  unsigned u = (unsigned)x;
+  base = Min(16, Max(2, base));
+  if (x < 0) {
+    ArrCat(pArr, '-');
+    u = 0u - u; /* also works for the most negative int */
+  }
+  ArrStrCatU32(pArr, u, base, 1);
+}
+
+void ArrStrCatHex(char** pArr, int x, int minDigits) {
+  ArrStrCatU32(pArr, (unsigned)x, 16, minDigits);
+}
+
+void ArrStrCatFlt(char** pArr, float x, int decimals) {
+  static unsigned pow10[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+  };
+  unsigned whole, frac;
+  int exponent = 0;
+  decimals = Min(9, Max(0, decimals));
+  if (x != x) {
+    ArrStrCat(pArr, "nan");
+    return;
+  }
+  if (x < 0) {
+    ArrCat(pArr, '-');
+    x = -x;
+  }
+  if (x - x != 0) {
+    ArrStrCat(pArr, "inf");
+    return;
+  }
+  if (x >= 1e9f) {
+    /* doesn't fit the integer part, switch to scientific notation */
+    while (x >= 10) {
+      x /= 10;
+      ++exponent;
+    }
+  }
+  whole = (unsigned)x;
+  frac = (unsigned)((x - whole) * pow10[decimals] + 0.5f);
+  if (frac >= pow10[decimals]) {
+    frac -= pow10[decimals];
+    ++whole;
+  }
+  ArrStrCatU32(pArr, whole, 10, 1);
+  if (decimals) {
+    ArrCat(pArr, '.');
+    ArrStrCatU32(pArr, frac, 10, decimals);
+  }
+  if (exponent) {
+    ArrStrCat(pArr, "e+");
+    ArrStrCatU32(pArr, exponent, 10, 1);
+  }
+}
+
 /* ---------------------------------------------------------------------------------------------- */
 
+/* chunks are never freed until RmArena. rewinding or resetting just moves back to an earlier chunk
+ * and the later ones are reused as we allocate again.
+ * marks are the total size of the chunks before the current one plus the used bytes in the current
+ * one, so they fit in a plain int */
+
+typedef struct _ArenaChunk {
+  char* mem;
+  int size;
+  int fill;  /* bytes used when we moved on to the next chunk, for stats */
+  int dirty; /* bytes that have been handed out at least once and aren't zero anymore */
+} ArenaChunk;
+
 struct _Arena {
-  char** chunks;
-  char* p;
-  int freeBytes;
+  ArenaChunk* chunks;
+  int cur;  /* current chunk, -1 if there's none yet */
+  int used; /* bytes used in the current chunk */
+  int base; /* total size of the chunks before cur */
   int minChunkSize;
 };
 
@@ -997,6 +1771,7 @@ Arena MkArenaEx(int chunkSize) {
   Arena arena = Alloc(sizeof(struct _Arena));
   if (arena) {
     arena->minChunkSize = chunkSize;
+    arena->cur = -1;
   }
   return arena;
 }
@@ -1005,27 +1780,109 @@ void RmArena(Arena arena) {
   if (arena) {
     int i;
     for (i = 0; i < ArrLen(arena->chunks); ++i) {
-      Free(arena->chunks[i]);
+      Free(arena->chunks[i].mem);
     }
     RmArr(arena->chunks);
   }
   Free(arena);
 }
 
+static int ArenaChunkSize(Arena arena, int i) {
+  return i >= 0 ? arena->chunks[i].size : 0;
+}
+
+static void ArenaNextChunk(Arena arena) {
+  if (arena->cur >= 0) {
+    arena->chunks[arena->cur].fill = arena->used;
+    arena->base += arena->chunks[arena->cur].size;
+  }
+  ++arena->cur;
+  arena->used = 0;
+}
+
+/* insert a new chunk right after the current one so the chunks after it can still be reused */
+static int ArenaInsertChunk(Arena arena, int size) {
+  int i = arena->cur + 1;
+  int tail = ArrLen(arena->chunks) - i;
+  char* mem = AllocTagged("Arena", size);
+  ArenaChunk* chunk;
+  if (!mem) {
+    return 0;
+  }
+  ArrAlloc(&arena->chunks, 1);
+  chunk = &arena->chunks[i];
+  MemMv(chunk + 1, chunk, tail * sizeof(ArenaChunk));
+  MemSet(chunk, 0, sizeof(ArenaChunk));
+  chunk->mem = mem;
+  chunk->size = size;
+  return 1;
+}
+
 void* ArenaAlloc(Arena arena, int n) {
-  void* res;
-  if (arena->freeBytes < n) {
-    int size = Max(n, arena->minChunkSize);
-    size = AlignUpToPowerOfTwo(size, 8);
-    ArrCat(&arena->chunks, Alloc(size));
-    arena->p = arena->chunks[ArrLen(arena->chunks) - 1];
-    arena->freeBytes = size;
-  }
-  res = arena->p;
-  if (!res) {
+  ArenaChunk* chunk;
+  char* res;
+  if (n < 0 || n > 0x7fffffff - 8) {
     return 0;
   }
-  arena->p += AlignUpToPowerOfTwo(n, 8);
+  n = AlignUpToPowerOfTwo(n, 8);
+  if (arena->cur < 0 || n > ArenaChunkSize(arena, arena->cur) - arena->used) {
+    int next = arena->cur + 1;
+    if (next >= ArrLen(arena->chunks) || arena->chunks[next].size < n) {
+      int size = AlignUpToPowerOfTwo(Max(n, arena->minChunkSize), 8);
+      if (!ArenaInsertChunk(arena, size)) {
+        return 0;
+      }
+    }
+    ArenaNextChunk(arena);
+  }
+  chunk = &arena->chunks[arena->cur];
+  res = chunk->mem + arena->used;
+  arena->used += n;
+  if (chunk->dirty > res - chunk->mem) {
+    MemSet(res, 0, Min(n, chunk->dirty - (res - chunk->mem)));
+  }
+  chunk->dirty = Max(chunk->dirty, arena->used);
+  return res;
+}
+
+int ArenaMark(Arena arena) {
+  return arena->base + arena->used;
+}
+
+void ArenaRewind(Arena arena, int mark) {
+  int i, base = 0;
+  if (mark >= ArenaMark(arena)) {
+    return;
+  }
+  for (i = 0; i < arena->cur && mark >= base + arena->chunks[i].size; ++i) {
+    base += arena->chunks[i].size;
+  }
+  arena->cur = i;
+  arena->base = base;
+  arena->used = mark - base;
+}
+
+void ArenaReset(Arena arena) {
+  arena->cur = ArrLen(arena->chunks) ? 0 : -1;
+  arena->base = 0;
+  arena->used = 0;
+}
+
+int ArenaBytesUsed(Arena arena) {
+  int i, res = arena->used;
+  for (i = 0; i < arena->cur; ++i) {
+    res += arena->chunks[i].fill;
+  }
+  return res;
+}
+
+int ArenaNumChunks(Arena arena) { return ArrLen(arena->chunks); }
+
+int ArenaWaste(Arena arena) {
+  int i, res = 0;
+  for (i = 0; i < arena->cur; ++i) {
+    res += arena->chunks[i].size - arena->chunks[i].fill;
+  }
   return res;
 }
 
@@ -1039,82 +1896,401 @@ void* ArenaMemDup(Arena arena, void* p, int n) {
 
 /* ---------------------------------------------------------------------------------------------- */
 
-typedef struct _MapItem {
-  void* val;
-  int key;
-} MapItem;
+/* free elements store the pointer to the next free element in their first bytes */
 
-struct _Map {
-  MapItem* arr;
-  int* keys;
-  int* isset; /* bit mask of set indices into arr. this way we don't have to reserve zero kvals */
+struct _Pool {
+  char** slabs;
+  void* free;
+  char* name;
+  int elementSize;
+  int slabLen;
+  int live;
 };
 
-Map MkMap() {
-  return Alloc(sizeof(struct _Map));
+Pool MkPool(int elementSize) {
+  return MkPoolEx(elementSize, Max(4096 / elementSize, 16));
 }
 
-static void RmMapContents(Map map) {
-  if (map) {
-    RmArr(map->arr);
-    RmArr(map->keys);
-    RmArr(map->isset);
+Pool MkPoolEx(int elementSize, int slabLen) {
+  Pool pool = Alloc(sizeof(struct _Pool));
+  if (pool) {
+    pool->elementSize = AlignUpToPowerOfTwo(Max(elementSize, (int)sizeof(void*)), 8);
+    pool->slabLen = Max(slabLen, 1);
   }
+  return pool;
 }
 
-static void RmMapContainer(Map map) {
-  Free(map);
-}
-
-void RmMap(Map map) {
-  RmMapContents(map);
-  RmMapContainer(map);
+void RmPool(Pool pool) {
+  if (pool) {
+    int i;
+#ifdef WEEBCORE_MEMDIAG
+    if (pool->live) {
+      char* line = 0;
+      ArrStrCat(&line, "leak: ");
+      ArrStrCat(&line, pool->name ? pool->name : "Pool");
+      ArrStrCat(&line, ": ");
+      ArrStrCatI32(&line, pool->live, 10);
+      ArrStrCat(&line, " live pool elements");
+      ArrCat(&line, 0);
+      Log(line);
+      RmArr(line);
+    }
+#endif
+    for (i = 0; i < ArrLen(pool->slabs); ++i) {
+      Free(pool->slabs[i]);
+    }
+    RmArr(pool->slabs);
+  }
+  Free(pool);
 }
 
-static int MapIsSet(Map map, int i) {
-  return map->isset[i / 32] & (0x80000000 >> (i % 32));
+static void PoolGrow(Pool pool) {
+  char* slab = AllocRawTagged(pool->name ? pool->name : "Pool", pool->elementSize * pool->slabLen);
+  if (slab) {
+    int i;
+    ArrCat(&pool->slabs, slab);
+    /* link backwards so elements are handed out in address order */
+    for (i = pool->slabLen - 1; i >= 0; --i) {
+      void** p = (void**)(slab + i * pool->elementSize);
+      *p = pool->free;
+      pool->free = p;
+    }
+  }
 }
 
-void MapSet(Map map, int key, void* val) {
-  int starti, i;
-  int cap = ArrCap(map->arr);
-  if (2 * ArrLen(map->keys) >= cap) {
-    Map new = MkMap();
-    if (!cap) {
-      cap = 16;
-    }
-    cap *= 2;
-    ArrAlloc(&new->arr, cap);
-    ArrAlloc(&new->isset, Max(cap / 32, 1));
-    for (i = 0; i < ArrLen(map->keys); ++i) {
-      MapSet(new, map->keys[i], MapGet(map, map->keys[i]));
-    }
-    RmMapContents(map);
-    *map = *new;
-    RmMapContainer(new);
-  }
-  starti = HashI32(key) % cap;
-  for (i = starti; MapIsSet(map, i) && map->arr[i].key != key;) {
-    i = (i + 1) % cap;
-    if (i == starti) { return; }
-  }
-  map->isset[i / 32] |= 0x80000000 >> (i % 32);
+void* PoolAlloc(Pool pool) {
+  void** p;
+  if (!pool->free) {
+    PoolGrow(pool);
+    if (!pool->free) {
+      return 0;
+    }
+  }
+  p = pool->free;
+  pool->free = *p;
+  ++pool->live;
+  MemSet(p, 0, pool->elementSize);
+  return p;
+}
+
+void PoolFree(Pool pool, void* p) {
+  if (p) {
+    *(void**)p = pool->free;
+    pool->free = p;
+    --pool->live;
+  }
+}
+
+void SetPoolName(Pool pool, char* name) { pool->name = name; }
+int PoolLive(Pool pool) { return pool->live; }
+
+/* ---------------------------------------------------------------------------------------------- */
+
+/* use the compiler's ctz/popcount when we can, they compile down to a single instruction on most
+ * targets. the fallbacks are branchless bit tricks */
+
+#if defined(__GNUC__) || defined(__clang__)
+
+int BitScan(int x) { return x ? __builtin_ctz((unsigned)x) : -1; }
+int BitCount(int x) { return __builtin_popcount((unsigned)x); }
+
+#else
+
+int BitScan(int x) {
+  static char debruijn[32] = {
+    0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+    31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+  };
+  unsigned u = (unsigned)x;
+  if (!u) {
+    return -1;
+  }
+  return debruijn[(((u & (0u - u)) * 0x077cb531u) & 0xffffffffu) >> 27];
+}
+
+int BitCount(int x) {
+  unsigned u = (unsigned)x;
+  u = u - ((u >> 1) & 0x55555555u);
+  u = (u & 0x33333333u) + ((u >> 2) & 0x33333333u);
+  u = (u + (u >> 4)) & 0x0f0f0f0fu;
+  return (int)(((u * 0x01010101u) & 0xffffffffu) >> 24);
+}
+
+#endif
+
+void BitsResize(int** pBits, int numBits) {
+  int words = (numBits + 31) / 32;
+  int len = ArrLen(*pBits);
+  if (words > len) {
+    int* p = ArrAlloc(pBits, words - len);
+    if (p) {
+      MemSet(p, 0, (words - len) * sizeof(int));
+    }
+  }
+}
+
+void BitsSet(int* bits, int i) { bits[i / 32] |= 1 << (i % 32); }
+void BitsClr(int* bits, int i) { bits[i / 32] &= ~(1 << (i % 32)); }
+int BitsTest(int* bits, int i) { return (bits[i / 32] >> (i % 32)) & 1; }
+
+void BitsClrAll(int* bits) {
+  MemSet(bits, 0, ArrLen(bits) * sizeof(int));
+}
+
+/* flip is 0 to look for set bits, ~0 to look for clear bits */
+static int BitsScanEx(int* bits, int start, int flip) {
+  int i = start / 32, len = ArrLen(bits);
+  int word;
+  if (start < 0 || i >= len) {
+    return -1;
+  }
+  /* mask out the bits before start in the first word */
+  word = (bits[i] ^ flip) & (int)(~0u << (start % 32));
+  while (!word) {
+    if (++i >= len) {
+      return -1;
+    }
+    word = bits[i] ^ flip;
+  }
+  return i * 32 + BitScan(word);
+}
+
+int BitsScan(int* bits, int start) { return BitsScanEx(bits, start, 0); }
+int BitsScanClr(int* bits, int start) { return BitsScanEx(bits, start, ~0); }
+
+int BitsCount(int* bits) {
+  int i, res = 0;
+  for (i = 0; i < ArrLen(bits); ++i) {
+    res += BitCount(bits[i]);
+  }
+  return res;
+}
+
+void BitsAnd(int* dst, int* src) {
+  int i, len = ArrLen(dst), srcLen = Min(len, ArrLen(src));
+  for (i = 0; i < srcLen; ++i) {
+    dst[i] &= src[i];
+  }
+  for (; i < len; ++i) {
+    dst[i] = 0;
+  }
+}
+
+void BitsOr(int** pDst, int* src) {
+  int i, len = ArrLen(src);
+  int* dst;
+  BitsResize(pDst, len * 32);
+  dst = *pDst;
+  for (i = 0; i < len; ++i) {
+    dst[i] |= src[i];
+  }
+}
+
+void BitsAndNot(int* dst, int* src) {
+  int i, len = Min(ArrLen(dst), ArrLen(src));
+  for (i = 0; i < len; ++i) {
+    dst[i] &= ~src[i];
+  }
+}
+
+int BitsContains(int* bits, int* sub) {
+  int i, len = ArrLen(bits), subLen = ArrLen(sub);
+  for (i = 0; i < subLen; ++i) {
+    int word = i < len ? bits[i] : 0;
+    if ((word & sub[i]) != sub[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void BitsIdxs(int* bits, int** pIdxs) {
+  int i, j = 0;
+  int* idxs = ArrAlloc(pIdxs, BitsCount(bits));
+  if (!idxs) { return; }
+  for (i = 0; i < ArrLen(bits); ++i) {
+    int word = bits[i];
+    while (word) {
+      idxs[j++] = i * 32 + BitScan(word);
+      word &= word - 1;
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+/* open addressing with linear probing. the table is kept at most half full and its size is always a
+ * power of two so we can mask the hash instead of doing a modulo.
+ * keys are stored as pointer-sized values so int keys and ptr keys share the same code. the only
+ * difference is the hash function, selected by the PTR_KEYS flag */
+
+typedef struct _MapItem {
+  void* key;
+  void* val;
+} MapItem;
+
+struct _Map {
+  MapItem* arr;
+  void** keys;
+  int* isset; /* bit mask of set indices into arr. this way we don't have to reserve zero kvals */
+  int flags;
+};
+
+Map MkMap() {
+  return Alloc(sizeof(struct _Map));
+}
+
+Map MkPtrMap() {
+  Map map = MkMap();
+  if (map) {
+    map->flags |= PTR_KEYS;
+  }
+  return map;
+}
+
+static void RmMapContents(Map map) {
+  if (map) {
+    RmArr(map->arr);
+    RmArr(map->keys);
+    RmArr(map->isset);
+  }
+}
+
+static void RmMapContainer(Map map) {
+  Free(map);
+}
+
+void RmMap(Map map) {
+  RmMapContents(map);
+  RmMapContainer(map);
+}
+
+static int MapIsSet(Map map, int i) {
+  return BitsTest(map->isset, i);
+}
+
+static int MapHash(Map map, void* key) {
+  return (map->flags & PTR_KEYS) ? HashPtr(key) : HashI32((int)key);
+}
+
+static void MapGrow(Map map) {
+  struct _Map old = *map;
+  int i, cap = Max(ArrLen(old.arr) * 2, 32);
+  map->arr = 0;
+  map->keys = 0;
+  map->isset = 0;
+  ArrAlloc(&map->arr, cap);
+  BitsResize(&map->isset, cap);
+  for (i = 0; i < ArrLen(old.keys); ++i) {
+    MapSetp(map, old.keys[i], MapGetp(&old, old.keys[i]));
+  }
+  RmMapContents(&old);
+}
+
+/* there's no removal, so internal users clear keys by setting them to NULL and call this once the
+ * dead keys pile up to rebuild the table without them */
+static void MapPrune(Map map) {
+  struct _Map old = *map;
+  int i;
+  map->arr = 0;
+  map->keys = 0;
+  map->isset = 0;
+  for (i = 0; i < ArrLen(old.keys); ++i) {
+    void* val = MapGetp(&old, old.keys[i]);
+    if (val) {
+      MapSetp(map, old.keys[i], val);
+    }
+  }
+  RmMapContents(&old);
+}
+
+void MapSetp(Map map, void* key, void* val) {
+  int i, mask;
+  if (2 * (ArrLen(map->keys) + 1) > ArrLen(map->arr)) {
+    MapGrow(map);
+  }
+  mask = ArrLen(map->arr) - 1;
+  for (i = MapHash(map, key) & mask; MapIsSet(map, i); i = (i + 1) & mask) {
+    if (map->arr[i].key == key) {
+      map->arr[i].val = val;
+      return;
+    }
+  }
+  BitsSet(map->isset, i);
   map->arr[i].key = key;
   map->arr[i].val = val;
+  ArrCat(&map->keys, key);
 }
 
-void* MapGet(Map map, int key) {
-  int starti, i;
-  int cap = ArrCap(map->arr);
-  if (!cap) {
+static void* MapProbe(Map map, void* key, int i) {
+  int mask = ArrLen(map->arr) - 1;
+  /* the table is never full so we always hit an empty slot if the key is not there */
+  for (; MapIsSet(map, i); i = (i + 1) & mask) {
+    if (map->arr[i].key == key) {
+      return map->arr[i].val;
+    }
+  }
+  return 0;
+}
+
+void* MapGetp(Map map, void* key) {
+  int mask = ArrLen(map->arr) - 1;
+  if (mask < 0) {
     return 0;
   }
-  starti = HashI32(key) % cap;
-  for (i = starti; map->arr[i].key != key;) {
-    i = (i + 1) % cap;
-    if (i == starti) { return 0; }
+  return MapProbe(map, key, MapHash(map, key) & mask);
+}
+
+/* big enough to cover memory latency, small enough for the indices to stay in registers/L1 */
+#define MAP_BATCH 16
+
+/* hash the whole batch and prefetch its slots first so the cache misses overlap */
+static void MapGetBatch(Map map, void** keys, int n, void** outVals) {
+  int idx[MAP_BATCH];
+  int i, mask = ArrLen(map->arr) - 1;
+  for (i = 0; i < n; ++i) {
+    idx[i] = MapHash(map, keys[i]) & mask;
+    Prefetch(&map->isset[idx[i] / 32]);
+    Prefetch(&map->arr[idx[i]]);
+  }
+  for (i = 0; i < n; ++i) {
+    outVals[i] = MapProbe(map, keys[i], idx[i]);
+  }
+}
+
+void MapGetManyp(Map map, void** keys, int n, void** outVals) {
+  int i;
+  if (!ArrLen(map->arr)) {
+    MemSet(outVals, 0, n * sizeof(void*));
+    return;
+  }
+  for (i = 0; i < n; i += MAP_BATCH) {
+    MapGetBatch(map, &keys[i], Min(MAP_BATCH, n - i), &outVals[i]);
+  }
+}
+
+void MapGetMany(Map map, int* keys, int n, void** outVals) {
+  void* batch[MAP_BATCH];
+  int i, j;
+  if (!ArrLen(map->arr)) {
+    MemSet(outVals, 0, n * sizeof(void*));
+    return;
+  }
+  for (i = 0; i < n; i += MAP_BATCH) {
+    int len = Min(MAP_BATCH, n - i);
+    for (j = 0; j < len; ++j) {
+      batch[j] = (void*)keys[i + j];
+    }
+    MapGetBatch(map, batch, len, &outVals[i]);
   }
-  return map->arr[i].val;
+}
+
+void MapSet(Map map, int key, void* val) {
+  MapSetp(map, (void*)key, val);
+}
+
+void* MapGet(Map map, int key) {
+  return MapGetp(map, (void*)key);
 }
 
 int MapColls(Map map) {
@@ -1122,18 +2298,19 @@ int MapColls(Map map) {
   int colls = 0;
   Map counts = MkMap();
   for (i = 0; i < ArrLen(map->keys); ++i) {
-    int hash = HashI32(map->keys[i]);
+    int hash = MapHash(map, map->keys[i]);
     MapSet(counts, hash, (void*)((int)MapGet(counts, hash) + 1));
   }
   for (i = 0; i < ArrLen(counts->keys); ++i) {
-    colls += (int)MapGet(counts, counts->keys[i]) - 1;
+    colls += (int)MapGetp(counts, counts->keys[i]) - 1;
   }
   RmMap(counts);
   return colls;
 }
 
 int MapNumKeys(Map map) { return ArrLen(map->keys); }
-int MapKey(Map map, int i) { return map->keys[i]; }
+int MapKey(Map map, int i) { return (int)map->keys[i]; }
+void* MapKeyp(Map map, int i) { return map->keys[i]; }
 
 /* ---------------------------------------------------------------------------------------------- */
 
@@ -1249,8 +2426,8 @@ int HashColls(Hash hash) {
     int strhash = HashStr(k->data, k->len);
     MapSet(counts, strhash, (void*)((int)MapGet(counts, strhash) + 1));
   }
-  for (i = 0; i < ArrLen(counts->keys); ++i) {
-    colls += (int)MapGet(counts, counts->keys[i]) - 1;
+  for (i = 0; i < MapNumKeys(counts); ++i) {
+    colls += (int)MapGet(counts, MapKey(counts, i)) - 1;
   }
   RmMap(counts);
   return colls + MapColls(hash->map);
@@ -1266,6 +2443,7 @@ typedef struct { float r[4]; } PackerRect; /* left, right, top bottom */
 
 struct _Packer {
   PackerRect* rects;
+  Arena scratch; /* the temporary rect lists built by PakSplit and PakPrune */
 };
 
 /* adds a free rect */
@@ -1284,6 +2462,7 @@ Packer MkPacker(int width, int height) {
   if (pak) {
     /* initialize area to be one big free rect */
     ArrCatRect(&pak->rects, 0, width, 0, height);
+    pak->scratch = MkArenaEx(4096);
   }
   return pak;
 }
@@ -1291,10 +2470,19 @@ Packer MkPacker(int width, int height) {
 void RmPacker(Packer pak) {
   if (pak) {
     RmArr(pak->rects);
+    RmArena(pak->scratch);
   }
   Free(pak);
 }
 
+/* replace the free rects with the ones we built in the scratch arena. pak->rects only grows so it
+ * stops hitting the heap once it's big enough */
+static void PakSetRects(Packer pak, PackerRect* newRects, int mark) {
+  SetArrLen(pak->rects, 0);
+  ArrCatN(&pak->rects, newRects, ArrLen(newRects));
+  ArenaRewind(pak->scratch, mark);
+}
+
 /* find the best fit free rectangle (smallest area that can fit the rect).
  * initially we will have 1 big free rect that takes the entire area */
 static int PakFindFree(Packer pak, float* rect) {
@@ -1318,8 +2506,8 @@ static int PakFindFree(Packer pak, float* rect) {
  * partially intersects with. this will generate two or more smaller rects */
 static void PakSplit(Packer pak, float* rect) {
   PackerRect* rects = pak->rects;
-  int i;
-  PackerRect* newRects = 0;
+  int i, mark = ArenaMark(pak->scratch);
+  PackerRect* newRects = MkArenaArr(pak->scratch, sizeof(PackerRect), ArrLen(rects) + 4);
   for (i = 0; i < ArrLen(rects); ++i) {
     float* r = rects[i].r;
     if (RectSect(rect, r)) {
@@ -1331,15 +2519,14 @@ static void PakSplit(Packer pak, float* rect) {
       ArrCatRectFlts(&newRects, r);
     }
   }
-  RmArr(rects);
-  pak->rects = newRects;
+  PakSetRects(pak, newRects, mark);
 }
 
 /* after the split step, there will be redundant rects because we create 1 rect for each side */
 static void PakPrune(Packer pak) {
-  int i, j;
+  int i, j, mark = ArenaMark(pak->scratch);
   PackerRect* rects = pak->rects;
-  PackerRect* newRects = 0;
+  PackerRect* newRects = MkArenaArr(pak->scratch, sizeof(PackerRect), ArrLen(rects));
   for (i = 0; i < ArrLen(rects); ++i) {
     for (j = 0; j < ArrLen(rects); ++j) {
       if (i == j) { continue; }
@@ -1353,8 +2540,7 @@ static void PakPrune(Packer pak) {
       ArrCatRectFlts(&newRects, rects[i].r);
     }
   }
-  RmArr(rects);
-  pak->rects = newRects;
+  PakSetRects(pak, newRects, mark);
 }
 
 float* Pack(Packer pak, float* rect) {
@@ -1382,120 +2568,600 @@ void PackFree(Packer pak, float* rect) {
 
 /* ---------------------------------------------------------------------------------------------- */
 
-/* https://graphics.stanford.edu/~seander/bithacks.html */
-int RoundUpToPowerOfTwo(int x) {
-  --x;
-  x |= x >> 1;
-  x |= x >> 2;
-  x |= x >> 4;
-  x |= x >> 8;
-  x |= x >> 16;
-  return ++x;
-}
+/* cells are keyed by their x and y packed into 16 bits each, so cells 65536 apart share a list.
+ * that only costs extra candidates since every result is checked against the actual rects.
+ * Map can't remove keys, so a cell that empties out is mapped to 0 and its list is recycled. once
+ * the dead keys outnumber the live ones the map is rebuilt, so rects roaming around don't grow it.
+ * rects that span more than GRID_MAX_CELLS cells go in a separate list that every query scans, so a
+ * huge or infinite rect doesn't allocate or walk billions of cells */
+#define GRID_MAX_CELLS 256
+
+struct _Grid {
+  float invCellSize;
+  Map cells;     /* cell key -> index + 1 into lists, 0 if the cell is empty */
+  int** lists;   /* ids in each cell */
+  int* freeLists; /* indices of empty lists to reuse */
+  int* big;      /* ids of the rects that span too many cells */
+  float* rects;  /* 4 per id */
+  int* ranges;   /* first and last cell x, y covered by each id */
+  int* present;  /* bits */
+  int* marks;    /* last query that saw each id */
+  int stamp;
+};
 
-int StrLen(char* s) {
-  char* p;
-  for (p = s; *p; ++p);
-  return p - s;
+Grid MkGrid(float cellSize) {
+  Grid grid = Alloc(sizeof(struct _Grid));
+  if (grid) {
+    grid->invCellSize = 1 / cellSize;
+    grid->cells = MkMap();
+  }
+  return grid;
 }
 
-void StrCpy(char* dst, char* src) {
-  while (*src) {
-    *dst++ = *src++;
+void RmGrid(Grid grid) {
+  if (grid) {
+    int i;
+    for (i = 0; i < ArrLen(grid->lists); ++i) {
+      RmArr(grid->lists[i]);
+    }
+    RmArr(grid->lists);
+    RmArr(grid->freeLists);
+    RmArr(grid->big);
+    RmMap(grid->cells);
+    RmArr(grid->rects);
+    RmArr(grid->ranges);
+    RmArr(grid->present);
+    RmArr(grid->marks);
+    Free(grid);
   }
 }
 
-int StrCmp(char* a, char* b) {
-  while (1) {
-    if (*a < *b) { return -1; }
-    else if (*a > *b) { return 1; }
-    if (!*a || !*b) { break; }
-    ++a; ++b;
-  }
-  return 0;
+static int GridCoord(Grid grid, float v) {
+  int c;
+  v = Clamp(v * grid->invCellSize, -32767, 32767);
+  if (v != v) { v = 0; }
+  c = (int)v;
+  return c - (v < c);
 }
 
-int DecVarI32(char** pData) {
-  unsigned char* p;
-  int res = 0, shift = 0, more = 1;
-  for (p = (unsigned char*)*pData; more; ++p) {
-    more = *p & 0x80;
-    res |= (*p & 0x7F) << shift;
-    shift += 7;
-  }
-  *pData = (char*)p;
-  return res;
+static int GridKey(int x, int y) {
+  return (int)(((unsigned)y << 16) | ((unsigned)x & 0xffff));
 }
 
-int EncVarI32(void* data, int x) {
-  unsigned char* p = data;
-  unsigned u = (unsigned)x;
-  while (1) {
-    unsigned char* byte = p++;
-    *byte = u & 0x7F;
-    u >>= 7;
-    if (u) {
-      *byte |= 0x80;
+/* returns the cell's list or NULL if it doesn't exist and create is 0 */
+static int** GridList(Grid grid, int x, int y, int create) {
+  int key = GridKey(x, y);
+  int i = (int)MapGet(grid->cells, key);
+  if (!i) {
+    int n = ArrLen(grid->lists);
+    if (!create) { return 0; }
+    if (ArrLen(grid->freeLists)) {
+      i = grid->freeLists[ArrLen(grid->freeLists) - 1] + 1;
+      SetArrLen(grid->freeLists, ArrLen(grid->freeLists) - 1);
     } else {
-      break;
+      ArrCat(&grid->lists, 0);
+      if (ArrLen(grid->lists) == n) { return 0; }
+      i = n + 1;
     }
+    MapSet(grid->cells, key, (void*)i);
   }
-  return p - (unsigned char*)data;
+  return &grid->lists[i - 1];
 }
 
-void CatVarI32(char** pArr, int x) {
-  char* p = ArrReserve(pArr, 4);
-  int n = EncVarI32(p, x);
-  SetArrLen(*pArr, ArrLen(*pArr) + n);
+/* mark the cell as empty and put its list up for reuse. the list keeps its memory */
+static void GridFreeList(Grid grid, int x, int y, int** pList) {
+  int n = ArrLen(grid->freeLists);
+  ArrCat(&grid->freeLists, (int)(pList - grid->lists));
+  if (ArrLen(grid->freeLists) != n) {
+    MapSet(grid->cells, GridKey(x, y), 0);
+  }
 }
 
-int EncI32(void* data, int x) {
-  unsigned char* p = data;
-  p[0] = (x & 0x000000ff) >>  0;
-  p[1] = (x & 0x0000ff00) >>  8;
-  p[2] = (x & 0x00ff0000) >> 16;
-  p[3] = (x & 0xff000000) >> 24;
-  return 4;
+/* rebuild the cell map without the dead keys once they outnumber the live ones */
+static void GridCompact(Grid grid) {
+  int live = ArrLen(grid->lists) - ArrLen(grid->freeLists);
+  if (MapNumKeys(grid->cells) - live > Max(live, 64)) {
+    MapPrune(grid->cells);
+  }
 }
 
-int DecI32(char** pData) {
-  unsigned char* p = (unsigned char*)*pData;
-  *pData += 4;
-  return (p[0] <<  0) | (p[1] <<  8) | (p[2] << 16) | (p[3] << 24);
+static int InRange(int* r, int x, int y) {
+  return x >= r[0] && y >= r[1] && x <= r[2] && y <= r[3];
 }
 
-void CatI32(char** pArr, int x) {
-  char* p = ArrAlloc(pArr, 4);
-  EncI32(p, x);
+/* float so 65535 * 65535 doesn't overflow */
+static float RangeCells(int* r) {
+  return (float)(r[2] - r[0] + 1) * (r[3] - r[1] + 1);
 }
 
-int MemCmp(void* a, void* b, int n) {
-  unsigned char* p1 = a;
-  unsigned char* p2 = b;
-  int i;
+static int GridIsBig(int* r) {
+  return RangeCells(r) > GRID_MAX_CELLS;
+}
+
+static void ArrRmInt(int* arr, int val) {
+  int i, n = ArrLen(arr);
   for (i = 0; i < n; ++i) {
-    if (*p1 < *p2) {
-      return -1;
-    } else if (*p1 > *p2) {
-      return 1;
+    if (arr[i] == val) {
+      arr[i] = arr[n - 1];
+      SetArrLen(arr, n - 1);
+      break;
     }
   }
-  return 0;
-}
-
-void* MemDup(void* p, int n) {
-  void* new = Alloc(n);
-  if (new) { MemCpy(new, p, n); }
-  return new;
 }
 
-void SwpFlts(float* a, float* b) {
-  float tmp = *a;
-  *a = *b;
-  *b = tmp;
+/* add or remove id from the cells in range r that aren't in skip */
+static void GridLink(Grid grid, int id, int* r, int* skip, int add) {
+  int x, y;
+  if (GridIsBig(r)) {
+    if (add) {
+      ArrCat(&grid->big, id);
+    } else {
+      ArrRmInt(grid->big, id);
+    }
+    return;
+  }
+  for (y = r[1]; y <= r[3]; ++y) {
+    for (x = r[0]; x <= r[2]; ++x) {
+      int** pList;
+      if (skip && InRange(skip, x, y)) { continue; }
+      pList = GridList(grid, x, y, add);
+      if (!pList) {
+        continue;
+      } else if (add) {
+        ArrCat(pList, id);
+      } else {
+        int* list = *pList;
+        ArrRmInt(list, id);
+        if (!ArrLen(list)) {
+          GridFreeList(grid, x, y, pList);
+        }
+      }
+    }
+  }
 }
 
-void SwpPtrs(void** a, void** b) {
+void GridSet(Grid grid, int id, float* rect) {
+  int r[4];
+  int n = ArrLen(grid->marks);
+  if (id < 0) { return; }
+  if (id >= n) {
+    if (!FitArr((void**)&grid->rects, sizeof(float), SizeMul(id + 1, 4)) ||
+        !FitArr((void**)&grid->ranges, sizeof(int), SizeMul(id + 1, 4)) ||
+        !FitArr((void**)&grid->marks, sizeof(int), id + 1))
+    {
+      return;
+    }
+    MemSet(&grid->marks[n], 0, (id + 1 - n) * sizeof(int));
+    BitsResize(&grid->present, id + 1);
+    if (ArrLen(grid->present) * 32 <= id) { return; }
+  }
+  r[0] = GridCoord(grid, rect[0]);
+  r[1] = GridCoord(grid, rect[2]);
+  r[2] = GridCoord(grid, rect[1]);
+  r[3] = GridCoord(grid, rect[3]);
+  if (BitsTest(grid->present, id)) {
+    int* old = &grid->ranges[id * 4];
+    if (MemCmp(old, r, sizeof(r))) {
+      /* big ranges aren't in the cells, so there's nothing to diff against */
+      int diff = !GridIsBig(old) && !GridIsBig(r);
+      GridLink(grid, id, old, diff ? r : 0, 0);
+      GridLink(grid, id, r, diff ? old : 0, 1);
+    }
+  } else {
+    GridLink(grid, id, r, 0, 1);
+    BitsSet(grid->present, id);
+  }
+  MemCpy(&grid->ranges[id * 4], r, sizeof(r));
+  MemCpy(&grid->rects[id * 4], rect, sizeof(float) * 4);
+  GridCompact(grid);
+}
+
+void GridRm(Grid grid, int id) {
+  if (id >= 0 && id < ArrLen(grid->marks) && BitsTest(grid->present, id)) {
+    GridLink(grid, id, &grid->ranges[id * 4], 0, 0);
+    BitsClr(grid->present, id);
+    GridCompact(grid);
+  }
+}
+
+static int GridStamp(Grid grid) {
+  if (++grid->stamp <= 0) {
+    MemSet(grid->marks, 0, ArrLen(grid->marks) * sizeof(int));
+    grid->stamp = 1;
+  }
+  return grid->stamp;
+}
+
+void GridQueryRect(Grid grid, float* rect, int** pIds) {
+  int x, y, i, stamp;
+  int r[4];
+  r[0] = GridCoord(grid, rect[0]);
+  r[1] = GridCoord(grid, rect[2]);
+  r[2] = GridCoord(grid, rect[1]);
+  r[3] = GridCoord(grid, rect[3]);
+  /* when there's more cells to look at than ids, checking every id is cheaper */
+  if (RangeCells(r) > ArrLen(grid->marks)) {
+    for (i = BitsScan(grid->present, 0); i >= 0; i = BitsScan(grid->present, i + 1)) {
+      if (RectSect(&grid->rects[i * 4], rect)) {
+        ArrCat(pIds, i);
+      }
+    }
+    return;
+  }
+  stamp = GridStamp(grid);
+  for (y = r[1]; y <= r[3]; ++y) {
+    for (x = r[0]; x <= r[2]; ++x) {
+      int** pList = GridList(grid, x, y, 0);
+      if (!pList) { continue; }
+      for (i = 0; i < ArrLen(*pList); ++i) {
+        int id = (*pList)[i];
+        if (grid->marks[id] != stamp) {
+          grid->marks[id] = stamp;
+          if (RectSect(&grid->rects[id * 4], rect)) {
+            ArrCat(pIds, id);
+          }
+        }
+      }
+    }
+  }
+  for (i = 0; i < ArrLen(grid->big); ++i) {
+    int id = grid->big[i];
+    if (RectSect(&grid->rects[id * 4], rect)) {
+      ArrCat(pIds, id);
+    }
+  }
+}
+
+static void GridQueryPtList(Grid grid, int* list, float x, float y, int** pIds) {
+  int i;
+  for (i = 0; i < ArrLen(list); ++i) {
+    int id = list[i];
+    if (PtInRect(&grid->rects[id * 4], x, y)) {
+      ArrCat(pIds, id);
+    }
+  }
+}
+
+void GridQueryPt(Grid grid, float x, float y, int** pIds) {
+  int** pList = GridList(grid, GridCoord(grid, x), GridCoord(grid, y), 0);
+  if (pList) {
+    GridQueryPtList(grid, *pList, x, y, pIds);
+  }
+  GridQueryPtList(grid, grid->big, x, y, pIds);
+}
+
+/* a pair that shares several cells is only reported from the first one they share, the one at the
+ * max of both starting cells. this dedups without marks. big rects are checked against every id and
+ * are the only ones that report pairs with other big rects */
+void GridPairs(Grid grid, int** pPairs) {
+  int id;
+  for (id = BitsScan(grid->present, 0); id >= 0; id = BitsScan(grid->present, id + 1)) {
+    int* r = &grid->ranges[id * 4];
+    int x, y;
+    if (GridIsBig(r)) {
+      int other;
+      for (other = BitsScan(grid->present, 0); other >= 0;
+           other = BitsScan(grid->present, other + 1))
+      {
+        if (other == id || (other < id && GridIsBig(&grid->ranges[other * 4]))) {
+          continue;
+        }
+        if (RectSect(&grid->rects[id * 4], &grid->rects[other * 4])) {
+          ArrCat(pPairs, Min(id, other));
+          ArrCat(pPairs, Max(id, other));
+        }
+      }
+      continue;
+    }
+    for (y = r[1]; y <= r[3]; ++y) {
+      for (x = r[0]; x <= r[2]; ++x) {
+        int** pList = GridList(grid, x, y, 0);
+        int i;
+        if (!pList) { continue; }
+        for (i = 0; i < ArrLen(*pList); ++i) {
+          int other = (*pList)[i];
+          int* o = &grid->ranges[other * 4];
+          if (other <= id || Max(r[0], o[0]) != x || Max(r[1], o[1]) != y || !InRange(o, x, y)) {
+            continue;
+          }
+          if (RectSect(&grid->rects[id * 4], &grid->rects[other * 4])) {
+            ArrCat(pPairs, id);
+            ArrCat(pPairs, other);
+          }
+        }
+      }
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+/* https://prng.di.unimi.it/xoshiro128starstar.c . ints are assumed to be 32-bit like everywhere
+ * else in the core */
+struct _Rng {
+  unsigned s[4];
+};
+
+#define RngRotl(x, k) (((x) << (k)) | ((x) >> (32 - (k))))
+
+/* one step, with the state in locals so the Fill loops can keep it in registers */
+#define RngNext(res, s0, s1, s2, s3) { \
+  unsigned t = s1 << 9; \
+  res = RngRotl(s1 * 5, 7) * 9; \
+  s2 ^= s0; \
+  s3 ^= s1; \
+  s1 ^= s2; \
+  s0 ^= s3; \
+  s2 ^= t; \
+  s3 = RngRotl(s3, 11); \
+}
+
+Rng MkRng(int seed) {
+  Rng rng = Alloc(sizeof(struct _Rng));
+  if (rng) {
+    SeedRng(rng, seed);
+  }
+  return rng;
+}
+
+void RmRng(Rng rng) {
+  Free(rng);
+}
+
+/* expand the seed with splitmix32 so similar seeds give unrelated states. it never outputs four
+ * zeros in a row, which is the one state xoshiro can't leave */
+void SeedRng(Rng rng, int seed) {
+  unsigned x = (unsigned)seed;
+  int i;
+  for (i = 0; i < 4; ++i) {
+    unsigned z = (x += 0x9e3779b9);
+    z = (z ^ (z >> 16)) * 0x85ebca6b;
+    z = (z ^ (z >> 13)) * 0xc2b2ae35;
+    rng->s[i] = z ^ (z >> 16);
+  }
+}
+
+int RngI32(Rng rng) {
+  unsigned res;
+  RngNext(res, rng->s[0], rng->s[1], rng->s[2], rng->s[3]);
+  return (int)res;
+}
+
+/* reject the values below 2^32 % range so every remainder is equally likely */
+int RngRange(Rng rng, int min, int max) {
+  unsigned range = (unsigned)max - (unsigned)min;
+  unsigned threshold, x;
+  if (max <= min) {
+    return min;
+  }
+  threshold = (0u - range) % range;
+  do {
+    x = (unsigned)RngI32(rng);
+  } while (x < threshold);
+  return (int)((unsigned)min + x % range);
+}
+
+/* the top 24 bits fit exactly in a float's mantissa */
+float RngFlt(Rng rng) {
+  return ((unsigned)RngI32(rng) >> 8) * (1.0f / 16777216);
+}
+
+/* min + f * (max - min) can round up to max, so results are clamped to the float right below it */
+static float RngFltHi(float min, float max) {
+  union { float f; int i; } x;
+  if (max <= min) { return min; }
+  x.f = max;
+  if (max > 0) {
+    --x.i;
+  } else if (max < 0) {
+    ++x.i;
+  } else {
+    x.i = (int)0x80000001u; /* smallest negative denormal */
+  }
+  return x.f;
+}
+
+float RngFltRange(Rng rng, float min, float max) {
+  float res;
+  if (max <= min) {
+    return min;
+  }
+  res = min + RngFlt(rng) * (max - min);
+  return Min(res, RngFltHi(min, max));
+}
+
+void RngFillI32(Rng rng, int* dst, int n) {
+  unsigned s0 = rng->s[0], s1 = rng->s[1], s2 = rng->s[2], s3 = rng->s[3];
+  int i;
+  for (i = 0; i < n; ++i) {
+    unsigned res;
+    RngNext(res, s0, s1, s2, s3);
+    dst[i] = (int)res;
+  }
+  rng->s[0] = s0;
+  rng->s[1] = s1;
+  rng->s[2] = s2;
+  rng->s[3] = s3;
+}
+
+void RngFillFlts(Rng rng, float* dst, int n, float min, float max) {
+  unsigned s0 = rng->s[0], s1 = rng->s[1], s2 = rng->s[2], s3 = rng->s[3];
+  float scale = (max - min) * (1.0f / 16777216);
+  float hi = RngFltHi(min, max);
+  int i;
+  if (max <= min) {
+    for (i = 0; i < n; ++i) {
+      dst[i] = min;
+    }
+    return;
+  }
+  for (i = 0; i < n; ++i) {
+    unsigned res;
+    float x;
+    RngNext(res, s0, s1, s2, s3);
+    x = min + (res >> 8) * scale;
+    dst[i] = Min(x, hi);
+  }
+  rng->s[0] = s0;
+  rng->s[1] = s1;
+  rng->s[2] = s2;
+  rng->s[3] = s3;
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+/* https://graphics.stanford.edu/~seander/bithacks.html */
+int RoundUpToPowerOfTwo(int x) {
+  --x;
+  x |= x >> 1;
+  x |= x >> 2;
+  x |= x >> 4;
+  x |= x >> 8;
+  x |= x >> 16;
+  return ++x;
+}
+
+int StrLen(char* s) {
+  char* p;
+  for (p = s; *p; ++p);
+  return p - s;
+}
+
+void StrCpy(char* dst, char* src) {
+  while (*src) {
+    *dst++ = *src++;
+  }
+}
+
+int StrCmp(char* a, char* b) {
+  while (1) {
+    if (*a < *b) { return -1; }
+    else if (*a > *b) { return 1; }
+    if (!*a || !*b) { break; }
+    ++a; ++b;
+  }
+  return 0;
+}
+
+int DecVarI32(char** pData) {
+  unsigned char* p;
+  int res = 0, shift = 0, more = 1;
+  for (p = (unsigned char*)*pData; more; ++p) {
+    more = *p & 0x80;
+    res |= (*p & 0x7F) << shift;
+    shift += 7;
+  }
+  *pData = (char*)p;
+  return res;
+}
+
+int EncVarI32(void* data, int x) {
+  unsigned char* p = data;
+  unsigned u = (unsigned)x;
+  while (1) {
+    unsigned char* byte = p++;
+    *byte = u & 0x7F;
+    u >>= 7;
+    if (u) {
+      *byte |= 0x80;
+    } else {
+      break;
+    }
+  }
+  return p - (unsigned char*)data;
+}
+
+void CatVarI32(char** pArr, int x) {
+  char* p = ArrReserve(pArr, 4);
+  int n = EncVarI32(p, x);
+  SetArrLen(*pArr, ArrLen(*pArr) + n);
+}
+
+int EncI32(void* data, int x) {
+  unsigned char* p = data;
+  p[0] = (x & 0x000000ff) >>  0;
+  p[1] = (x & 0x0000ff00) >>  8;
+  p[2] = (x & 0x00ff0000) >> 16;
+  p[3] = (x & 0xff000000) >> 24;
+  return 4;
+}
+
+int DecI32(char** pData) {
+  unsigned char* p = (unsigned char*)*pData;
+  *pData += 4;
+  return (p[0] <<  0) | (p[1] <<  8) | (p[2] << 16) | (p[3] << 24);
+}
+
+void CatI32(char** pArr, int x) {
+  char* p = ArrAlloc(pArr, 4);
+  EncI32(p, x);
+}
+
+int MemCmp(void* a, void* b, int n) {
+  unsigned char* p1 = a;
+  unsigned char* p2 = b;
+  int i;
+  for (i = 0; i < n; ++i, ++p1, ++p2) {
+    if (*p1 < *p2) {
+      return -1;
+    } else if (*p1 > *p2) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void* MemDup(void* p, int n) {
+  void* new = Alloc(n);
+  if (new) { MemCpy(new, p, n); }
+  return new;
+}
+
+/* the int mem funcs are called 1 GiB at a time */
+#define MEM_CHUNK (1 << 30)
+
+void MemSetSz(void* p, unsigned char val, Sz n) {
+  char* d = p;
+  for (; n > MEM_CHUNK; n -= MEM_CHUNK, d += MEM_CHUNK) {
+    MemSet(d, val, MEM_CHUNK);
+  }
+  MemSet(d, val, (int)n);
+}
+
+void MemCpySz(void* dst, void* src, Sz n) {
+  char* d = dst;
+  char* s = src;
+  for (; n > MEM_CHUNK; n -= MEM_CHUNK, d += MEM_CHUNK, s += MEM_CHUNK) {
+    MemCpy(d, s, MEM_CHUNK);
+  }
+  MemCpy(d, s, (int)n);
+}
+
+/* go back to front when dst is after src so a chunk never overwrites source bytes that haven't
+ * been moved yet */
+void MemMvSz(void* dst, void* src, Sz n) {
+  char* d = dst;
+  char* s = src;
+  if (d <= s) {
+    for (; n > MEM_CHUNK; n -= MEM_CHUNK, d += MEM_CHUNK, s += MEM_CHUNK) {
+      MemMv(d, s, MEM_CHUNK);
+    }
+    MemMv(d, s, (int)n);
+  } else {
+    for (; n > MEM_CHUNK; n -= MEM_CHUNK) {
+      MemMv(d + n - MEM_CHUNK, s + n - MEM_CHUNK, MEM_CHUNK);
+    }
+    MemMv(d, s, (int)n);
+  }
+}
+
+void SwpFlts(float* a, float* b) {
+  float tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+void SwpPtrs(void** a, void** b) {
   void* tmp = *a;
   *a = *b;
   *b = tmp;
@@ -1519,6 +3185,41 @@ int HashI32(int x) {
   return x;
 }
 
+/* murmur3 finalizer. ptrs are usually aligned so the low bits carry little information, we need
+ * a full avalanche to spread the high bits down where the Map index mask is */
+int HashPtr(void* p) {
+  unsigned long x = (unsigned long)p;
+  unsigned h = (unsigned)(x ^ (x >> 16 >> 16)); /* two shifts so it's not UB on 32-bit longs */
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return (int)h;
+}
+
+int SizeMul(int a, int b) {
+  if (a < 0 || b < 0 || (b && a > 0x7fffffff / b)) {
+    return -1;
+  }
+  return a * b;
+}
+
+int SizeAdd(int a, int b) {
+  if (a < 0 || b < 0 || a > 0x7fffffff - b) {
+    return -1;
+  }
+  return a + b;
+}
+
+Sz SzMul(Sz a, Sz b) {
+  return b && a > (Sz)-1 / b ? (Sz)-1 : a * b;
+}
+
+Sz SzAdd(Sz a, Sz b) {
+  return a > (Sz)-1 - b ? (Sz)-1 : a + b;
+}
+
 int AlignDownToPowerOfTwo(int x, int a) { return x & ~(a - 1); }
 int AlignUpToPowerOfTwo(int x, int a) { return AlignDownToPowerOfTwo(x + a - 1, a); }
 
@@ -1529,55 +3230,272 @@ char* I32ToArrStr(int x, int base) {
   return res;
 }
 
-void ArrStrCatI32(char** res, int x, int base) {
-  static char* charset = "0123456789abcdef";
-  int i, tmplen;
-  char* tmp = 0;
-  base = Min(16, Max(1, base));
-  if (x < 0) {
-    ArrCat(res, '-');
-    x *= -1;
+void QsortStrs(char** strarr, int len) {
+  Qsort((void**)strarr, len, (QsortCmp*)StrCmp);
+}
+
+/* all the sorts share the same code for ptr arrays and element arrays. for ptr arrays (deref) the
+ * elements are pointer sized and we pass the pointers to cmp instead of pointers to the elements */
+
+#define SORT_INSERTION_MAX 16
+
+typedef struct _Sorter {
+  char* base;
+  int size;
+  int deref;
+  QsortCmp* cmp;
+} Sorter;
+
+static void MkSorter(Sorter* s, void* base, int size, int deref, QsortCmp* cmp) {
+  s->base = base;
+  s->size = size;
+  s->deref = deref;
+  s->cmp = cmp;
+}
+
+static char* SortAt(Sorter* s, int i) { return s->base + i * s->size; }
+
+static int SortCmp(Sorter* s, char* a, char* b) {
+  return s->deref ? s->cmp(*(void**)a, *(void**)b) : s->cmp(a, b);
+}
+
+static void SortSwp(Sorter* s, char* a, char* b) {
+  if (s->deref) {
+    SwpPtrs((void**)a, (void**)b);
+  } else if (!(s->size % sizeof(int)) && !(((unsigned long)a | (unsigned long)b) % sizeof(int))) {
+    int i, n = s->size / sizeof(int);
+    for (i = 0; i < n; ++i) {
+      int tmp = ((int*)a)[i];
+      ((int*)a)[i] = ((int*)b)[i];
+      ((int*)b)[i] = tmp;
+    }
+  } else {
+    int i;
+    for (i = 0; i < s->size; ++i) {
+      char tmp = a[i];
+      a[i] = b[i];
+      b[i] = tmp;
+    }
   }
-  while (x) {
-    ArrCat(&tmp, charset[x % base]);
-    x /= base;
+}
+
+/* stable, used for small ranges and as the last resort of StableSort */
+static void InsertionSort(Sorter* s, int lo, int hi) {
+  int i, j;
+  for (i = lo + 1; i < hi; ++i) {
+    for (j = i; j > lo && SortCmp(s, SortAt(s, j - 1), SortAt(s, j)) > 0; --j) {
+      SortSwp(s, SortAt(s, j - 1), SortAt(s, j));
+    }
+  }
+}
+
+static void HeapSift(Sorter* s, int lo, int root, int n) {
+  while (1) {
+    int child = 2 * root + 1;
+    if (child >= n) {
+      break;
+    }
+    if (child + 1 < n && SortCmp(s, SortAt(s, lo + child), SortAt(s, lo + child + 1)) < 0) {
+      ++child;
+    }
+    if (SortCmp(s, SortAt(s, lo + root), SortAt(s, lo + child)) >= 0) {
+      break;
+    }
+    SortSwp(s, SortAt(s, lo + root), SortAt(s, lo + child));
+    root = child;
   }
-  if (ArrLen(tmp) <= 0) {
-    ArrCat(&tmp, '0');
+}
+
+static void HeapSort(Sorter* s, int lo, int hi) {
+  int i, n = hi - lo;
+  for (i = n / 2 - 1; i >= 0; --i) {
+    HeapSift(s, lo, i, n);
   }
-  tmplen = ArrLen(tmp);
-  for (i = 0; i < tmplen; ++i) {
-    ArrCat(res, tmp[tmplen - i - 1]);
+  for (i = n - 1; i > 0; --i) {
+    SortSwp(s, SortAt(s, lo), SortAt(s, lo + i));
+    HeapSift(s, lo, 0, i);
   }
-  RmArr(tmp);
 }
 
-void QsortStrs(char** strarr, int len) {
-  Qsort((void**)strarr, len, (QsortCmp*)StrCmp);
+/* move the median of lo, mid, hi - 1 to lo and partition around it. both scans stop on elements
+ * equal to the pivot so runs of duplicates still split in the middle */
+static int QsortPart(Sorter* s, int lo, int hi) {
+  int mid = lo + (hi - lo) / 2, i = lo, j = hi;
+  char* pivot;
+  if (SortCmp(s, SortAt(s, mid), SortAt(s, lo)) < 0) { SortSwp(s, SortAt(s, mid), SortAt(s, lo)); }
+  if (SortCmp(s, SortAt(s, hi - 1), SortAt(s, mid)) < 0) {
+    SortSwp(s, SortAt(s, hi - 1), SortAt(s, mid));
+    if (SortCmp(s, SortAt(s, mid), SortAt(s, lo)) < 0) { SortSwp(s, SortAt(s, mid), SortAt(s, lo)); }
+  }
+  SortSwp(s, SortAt(s, lo), SortAt(s, mid));
+  pivot = SortAt(s, lo);
+  while (1) {
+    do { ++i; } while (i < hi && SortCmp(s, SortAt(s, i), pivot) < 0);
+    do { --j; } while (SortCmp(s, SortAt(s, j), pivot) > 0);
+    if (i >= j) {
+      break;
+    }
+    SortSwp(s, SortAt(s, i), SortAt(s, j));
+  }
+  SortSwp(s, pivot, SortAt(s, j));
+  return j;
 }
 
-static int QsortPart(void** arr, int len, QsortCmp* cmp, int lo, int hi) {
-  void* pivot = arr[hi];
-  int i = 0, j;
-  for (j = 0; j < hi; ++j) {
-    if (cmp(arr[j], pivot) <= 0) {
-      SwpPtrs(&arr[i++], &arr[j]);
+/* recurse on the smaller half and loop on the bigger one so the stack stays O(log n) */
+static void IntroSort(Sorter* s, int lo, int hi, int depth) {
+  while (hi - lo > SORT_INSERTION_MAX) {
+    int p;
+    if (depth-- <= 0) {
+      HeapSort(s, lo, hi);
+      return;
+    }
+    p = QsortPart(s, lo, hi);
+    if (p - lo < hi - p) {
+      IntroSort(s, lo, p, depth);
+      lo = p + 1;
+    } else {
+      IntroSort(s, p + 1, hi, depth);
+      hi = p;
     }
   }
-  SwpPtrs(&arr[i], &arr[hi]);
-  return i;
+  InsertionSort(s, lo, hi);
 }
 
-static void QsortImpl(void** arr, int len, QsortCmp* cmp, int lo, int hi) {
-  if (lo < hi) {
-    int pivot = QsortPart(arr, len, cmp, lo, hi);
-    QsortImpl(arr, len, cmp, lo, pivot - 1);
-    QsortImpl(arr, len, cmp, pivot + 1, hi);
+static void SortRange(Sorter* s, int len) {
+  int depth = 0, n;
+  for (n = len; n > 1; n >>= 1) {
+    depth += 2;
   }
+  IntroSort(s, 0, len, depth);
 }
 
 void Qsort(void** arr, int len, QsortCmp* cmp) {
-  QsortImpl(arr, len, cmp, 0, len - 1);
+  Sorter s;
+  MkSorter(&s, arr, sizeof(void*), 1, cmp);
+  SortRange(&s, len);
+}
+
+void QsortEx(void* base, int len, int elementSize, QsortCmp* cmp) {
+  Sorter s;
+  MkSorter(&s, base, elementSize, 0, cmp);
+  SortRange(&s, len);
+}
+
+/* the left half is moved to tmp and merged back. taking from the left on ties keeps it stable */
+static void MergeSortRange(Sorter* s, char* tmp, int lo, int hi) {
+  int mid = lo + (hi - lo) / 2, i, j, k;
+  if (hi - lo <= SORT_INSERTION_MAX) {
+    InsertionSort(s, lo, hi);
+    return;
+  }
+  MergeSortRange(s, tmp, lo, mid);
+  MergeSortRange(s, tmp, mid, hi);
+  if (SortCmp(s, SortAt(s, mid - 1), SortAt(s, mid)) <= 0) {
+    return; /* already in order */
+  }
+  MemCpy(tmp, SortAt(s, lo), (mid - lo) * s->size);
+  for (i = 0, j = mid, k = lo; i < mid - lo && j < hi; ++k) {
+    char* left = tmp + i * s->size;
+    if (SortCmp(s, SortAt(s, j), left) < 0) {
+      MemCpy(SortAt(s, k), SortAt(s, j++), s->size);
+    } else {
+      MemCpy(SortAt(s, k), left, s->size);
+      ++i;
+    }
+  }
+  MemCpy(SortAt(s, k), tmp + i * s->size, (mid - lo - i) * s->size);
+}
+
+static void StableSortRange(Sorter* s, int len) {
+  char* tmp = len > SORT_INSERTION_MAX ? AllocRaw(SizeMul(len / 2 + 1, s->size)) : 0;
+  if (tmp) {
+    MergeSortRange(s, tmp, 0, len);
+  } else {
+    InsertionSort(s, 0, len);
+  }
+  Free(tmp);
+}
+
+void StableSort(void** arr, int len, QsortCmp* cmp) {
+  Sorter s;
+  MkSorter(&s, arr, sizeof(void*), 1, cmp);
+  StableSortRange(&s, len);
+}
+
+void StableSortEx(void* base, int len, int elementSize, QsortCmp* cmp) {
+  Sorter s;
+  MkSorter(&s, base, elementSize, 0, cmp);
+  StableSortRange(&s, len);
+}
+
+/* the sign bit is flipped when extracting digits so negative keys sort before positive ones.
+ * all 4 histograms are built in a single read of the keys, then each pass ping pongs between the
+ * arrays and the scratch memory */
+static int RadixDigit(int key, int pass) {
+  return (((unsigned)key ^ 0x80000000u) >> (pass * 8)) & 0xff;
+}
+
+static void RadixSortImpl(int* keys, int* vals, int n, int* tmpKeys, int* tmpVals) {
+  int counts[4][256];
+  int* srcKeys = keys;
+  int* srcVals = vals;
+  int i, pass;
+  MemSet(counts, 0, sizeof(counts));
+  for (i = 0; i < n; ++i) {
+    for (pass = 0; pass < 4; ++pass) {
+      ++counts[pass][RadixDigit(keys[i], pass)];
+    }
+  }
+  for (pass = 0; pass < 4; ++pass) {
+    int* count = counts[pass];
+    int sum = 0;
+    if (count[RadixDigit(srcKeys[0], pass)] == n) {
+      continue; /* every key has the same digit, this pass wouldn't move anything */
+    }
+    for (i = 0; i < 256; ++i) {
+      int c = count[i];
+      count[i] = sum;
+      sum += c;
+    }
+    for (i = 0; i < n; ++i) {
+      int dst = count[RadixDigit(srcKeys[i], pass)]++;
+      tmpKeys[dst] = srcKeys[i];
+      if (vals) {
+        tmpVals[dst] = srcVals[i];
+      }
+    }
+    SwpPtrs((void**)&srcKeys, (void**)&tmpKeys);
+    SwpPtrs((void**)&srcVals, (void**)&tmpVals);
+  }
+  if (srcKeys != keys) {
+    MemCpy(keys, srcKeys, n * sizeof(int));
+    if (vals) {
+      MemCpy(vals, srcVals, n * sizeof(int));
+    }
+  }
+}
+
+static int* RadixScratch(int** pScratch, int n) {
+  if (ArrLen(*pScratch) < n) {
+    ArrAlloc(pScratch, n - ArrLen(*pScratch));
+  }
+  return n >= 0 && ArrLen(*pScratch) >= n ? *pScratch : 0;
+}
+
+void RadixSort(int* keys, int** pScratch) {
+  int n = ArrLen(keys);
+  int* tmp;
+  if (n > 1 && (tmp = RadixScratch(pScratch, n))) {
+    RadixSortImpl(keys, 0, n, tmp, 0);
+  }
+}
+
+void RadixSortPairs(int* keys, int* vals, int** pScratch) {
+  int n = ArrLen(keys);
+  int* tmp;
+  if (n > 1 && (tmp = RadixScratch(pScratch, SizeMul(n, 2)))) {
+    RadixSortImpl(keys, vals, n, tmp, tmp + n);
+  }
 }
 
 /* ---------------------------------------------------------------------------------------------- */
@@ -1586,27 +3504,49 @@ void PutMeshRaw(Mesh mesh, Mat mat, Img img) {
   PutMeshRawEx(mesh, mat, img, 0, 0);
 }
 
+/* memory layout:
+ * float left_axis[4]; float up_axis[4]; float fwd_axis[4]; float translation[4]; */
+
+struct _Mat { float m[16]; };
+
+void PutMeshRawAff(Mesh mesh, float* aff, Img img) {
+  struct _Mat mat;
+  if (aff) {
+    AffToMatFlts(mat.m, aff);
+  } else {
+    IdentMatFlts(mat.m);
+  }
+  PutMeshRaw(mesh, &mat, img);
+}
+
+/* the tmp mats are embedded so a Trans is a single allocation */
 struct _Trans {
   float sX, sY;
   float x, y;
   float oX, oY;
   float deg;
-  Mat tempMat, tempMatOrtho;
+  struct _Mat tempMat, tempMatOrtho;
+  struct _Mat tempInvMat, tempInvMatOrtho;
   int dirty;
 };
 
+static Pool transPool;
+
 Trans MkTrans() {
-  Trans trans = Alloc(sizeof(struct _Trans));
-  trans->tempMat = MkMat();
-  trans->tempMatOrtho = MkMat();
-  ClrTrans(trans);
+  Trans trans;
+  if (!transPool) {
+    transPool = MkPool(sizeof(struct _Trans));
+    SetPoolName(transPool, "Trans");
+  }
+  trans = PoolAlloc(transPool);
+  if (trans) {
+    ClrTrans(trans);
+  }
   return trans;
 }
 
 void RmTrans(Trans trans) {
-  RmMat(trans->tempMat);
-  RmMat(trans->tempMatOrtho);
-  Free(trans);
+  PoolFree(transPool, trans);
 }
 
 void ClrTrans(Trans trans) {
@@ -1649,34 +3589,402 @@ Trans SetRot(Trans trans, float deg) {
   return trans;
 }
 
+/* Pos(x, y) Rot(deg) Scale(sX, sY) Pos(-oX, -oY) expanded by hand. the 2x2 part is scale * rot
+ * and the translation is the scaled, rotated -origin plus pos */
 static Mat CalcTrans(Trans trans, Mat mat, int ortho) {
-  Pos(mat, trans->x, trans->y);
-  Rot(mat, trans->deg);
+  float aff[6];
+  float s = 0, c = 1;
+  float sX = 1, sY = 1;
+  float oX, oY;
+  if (!mat) { return 0; }
+  if (trans->deg != 0) {
+    SinCos(trans->deg, &s, &c);
+  }
+  if (!ortho) {
+    sX = trans->sX;
+    sY = trans->sY;
+  }
+  oX = -trans->oX * sX;
+  oY = -trans->oY * sY;
+  aff[0] = sX * c;
+  aff[1] = sX * s;
+  aff[2] = -sY * s;
+  aff[3] = sY * c;
+  aff[4] = oX * c - oY * s + trans->x;
+  aff[5] = oX * s + oY * c + trans->y;
+  AffToMatFlts(mat->m, aff);
+  return mat;
+}
+
+/* Pos(oX, oY) Scale(1 / sX, 1 / sY) Rot(-deg) Pos(-x, -y), the same steps undone in reverse */
+static Mat CalcInvTrans(Trans trans, Mat mat, int ortho) {
+  float aff[6];
+  float s = 0, c = 1;
+  float iX = 1, iY = 1;
+  float x, y;
+  if (trans->deg != 0) {
+    SinCos(trans->deg, &s, &c);
+  }
   if (!ortho) {
-    Scale(mat, trans->sX, trans->sY);
+    iX = trans->sX != 0 ? 1 / trans->sX : 0;
+    iY = trans->sY != 0 ? 1 / trans->sY : 0;
+  }
+  x = -trans->x * c - trans->y * s;
+  y = trans->x * s - trans->y * c;
+  aff[0] = c * iX;
+  aff[1] = -s * iY;
+  aff[2] = s * iX;
+  aff[3] = c * iY;
+  aff[4] = x * iX + trans->oX;
+  aff[5] = y * iY + trans->oY;
+  AffToMatFlts(mat->m, aff);
+  return mat;
+}
+
+Mat ToMat(Trans trans) { return CalcTrans(trans, MkMat(), 0); }
+Mat ToMatOrtho(Trans trans) { return CalcTrans(trans, MkMat(), 1); }
+
+Mat ToTmpMat(Trans trans) {
+  if (trans->dirty & DIRTY) {
+    CalcTrans(trans, &trans->tempMat, 0);
+    trans->dirty &= ~DIRTY;
+  }
+  return &trans->tempMat;
+}
+
+Mat ToTmpMatOrtho(Trans trans) {
+  if (trans->dirty & ORTHO_DIRTY) {
+    CalcTrans(trans, &trans->tempMatOrtho, 1);
+    trans->dirty &= ~ORTHO_DIRTY;
+  }
+  return &trans->tempMatOrtho;
+}
+
+Mat ToTmpInvMat(Trans trans) {
+  if (trans->dirty & INV_DIRTY) {
+    CalcInvTrans(trans, &trans->tempInvMat, 0);
+    trans->dirty &= ~INV_DIRTY;
+  }
+  return &trans->tempInvMat;
+}
+
+Mat ToTmpInvMatOrtho(Trans trans) {
+  if (trans->dirty & INV_ORTHO_DIRTY) {
+    CalcInvTrans(trans, &trans->tempInvMatOrtho, 1);
+    trans->dirty &= ~INV_ORTHO_DIRTY;
+  }
+  return &trans->tempInvMatOrtho;
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+struct _TransBatch {
+  float* fields[LAST_TRANS_FIELD];
+  struct _Mat* mats;
+};
+
+TransBatch MkTransBatch() {
+  return Alloc(sizeof(struct _TransBatch));
+}
+
+void RmTransBatch(TransBatch batch) {
+  if (batch) {
+    int i;
+    for (i = 0; i < LAST_TRANS_FIELD; ++i) {
+      RmArr(batch->fields[i]);
+    }
+    RmArr(batch->mats);
+    Free(batch);
+  }
+}
+
+int TransBatchLen(TransBatch batch) {
+  return ArrLen(batch->mats);
+}
+
+int SetTransBatchLen(TransBatch batch, int len) {
+  int i, j, n = ArrLen(batch->mats);
+  if (len < 0) { return 0; }
+  if (len > n) {
+    /* reserve everything before touching any length so a failure leaves the batch consistent */
+    for (i = 0; i < LAST_TRANS_FIELD; ++i) {
+      if (!ArrReserve(&batch->fields[i], len - n)) { return 0; }
+    }
+    if (!ArrReserve(&batch->mats, len - n)) { return 0; }
+    for (i = 0; i < LAST_TRANS_FIELD; ++i) {
+      float value = (i == TRANS_SCALE_X || i == TRANS_SCALE_Y) ? 1 : 0;
+      for (j = n; j < len; ++j) {
+        batch->fields[i][j] = value;
+      }
+    }
+    for (j = n; j < len; ++j) {
+      IdentMatFlts(batch->mats[j].m);
+    }
+  }
+  for (i = 0; i < LAST_TRANS_FIELD; ++i) {
+    SetArrLen(batch->fields[i], len);
+  }
+  SetArrLen(batch->mats, len);
+  return 1;
+}
+
+float* TransBatchFlts(TransBatch batch, int field) {
+  return batch->fields[field];
+}
+
+Mat TransBatchMat(TransBatch batch, int i) {
+  return &batch->mats[i];
+}
+
+/* same closed form as CalcTrans over a range of the arrays. only the 6 affine floats of each mat
+ * are written, the rest stays identity from SetTransBatchLen */
+static void CalcTransBatch(TransBatch batch, int start, int end) {
+  float* x = batch->fields[TRANS_X];
+  float* y = batch->fields[TRANS_Y];
+  float* sX = batch->fields[TRANS_SCALE_X];
+  float* sY = batch->fields[TRANS_SCALE_Y];
+  float* oX = batch->fields[TRANS_ORIG_X];
+  float* oY = batch->fields[TRANS_ORIG_Y];
+  float* deg = batch->fields[TRANS_ROT];
+  int i;
+  for (i = start; i < end; ++i) {
+    float* m = batch->mats[i].m;
+    float s = 0, c = 1;
+    float ox = -oX[i] * sX[i], oy = -oY[i] * sY[i];
+    if (deg[i] != 0) {
+      SinCos(deg[i], &s, &c);
+    }
+    m[ 0] = sX[i] * c;
+    m[ 1] = sX[i] * s;
+    m[ 4] = -sY[i] * s;
+    m[ 5] = sY[i] * c;
+    m[12] = ox * c - oy * s + x[i];
+    m[13] = ox * s + oy * c + y[i];
+  }
+}
+
+void UpdTransBatch(TransBatch batch, int* dirty) {
+  int n = ArrLen(batch->mats);
+  int w, numWords;
+  if (!dirty) {
+    CalcTransBatch(batch, 0, n);
+    return;
+  }
+  /* walk the mask a word at a time. full words are done as a run, sparse ones bit by bit */
+  numWords = Min(ArrLen(dirty), (n + 31) / 32);
+  for (w = 0; w < numWords; ++w) {
+    int word = dirty[w];
+    int base = w * 32;
+    if (word == ~0) {
+      CalcTransBatch(batch, base, Min(n, base + 32));
+      continue;
+    }
+    while (word) {
+      int i = base + BitScan(word);
+      if (i >= n) { break; }
+      CalcTransBatch(batch, i, i + 1);
+      word &= word - 1;
+    }
+  }
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+#define TREE_FREE (-2) /* parent of a removed node */
+
+/* per-node arrays are indexed by node. the depth-first arrays (order, parentPos, world, dirty) are
+ * indexed by position in the walk and rebuilt whenever a parent changes */
+struct _TransTree {
+  Trans* trans;
+  int* parents;
+  struct _Mat* mats;
+  int* freeNodes;
+  int* order;
+  int* parentPos;
+  float* world; /* 6 affine floats per position, see IdentAff */
+  char* dirty;
+  int* pos;
+  int* childStart;
+  int* children;
+  int* stack;
+  int flags;
+};
+
+TransTree MkTransTree() {
+  return Alloc(sizeof(struct _TransTree));
+}
+
+void RmTransTree(TransTree tree) {
+  if (tree) {
+    RmArr(tree->trans);
+    RmArr(tree->parents);
+    RmArr(tree->mats);
+    RmArr(tree->freeNodes);
+    RmArr(tree->order);
+    RmArr(tree->parentPos);
+    RmArr(tree->world);
+    RmArr(tree->dirty);
+    RmArr(tree->pos);
+    RmArr(tree->childStart);
+    RmArr(tree->children);
+    RmArr(tree->stack);
+    Free(tree);
+  }
+}
+
+static int TransTreeValidParent(TransTree tree, int parent) {
+  return parent == -1 ||
+    (parent >= 0 && parent < ArrLen(tree->parents) && tree->parents[parent] != TREE_FREE);
+}
+
+int TransTreeAdd(TransTree tree, Trans trans, int parent) {
+  int node;
+  if (!TransTreeValidParent(tree, parent)) { return -1; }
+  if (ArrLen(tree->freeNodes)) {
+    node = tree->freeNodes[ArrLen(tree->freeNodes) - 1];
+    SetArrLen(tree->freeNodes, ArrLen(tree->freeNodes) - 1);
+  } else {
+    node = ArrLen(tree->parents);
+    if (!ArrReserve(&tree->trans, 1) || !ArrReserve(&tree->parents, 1) ||
+        !ArrReserve(&tree->mats, 1))
+    {
+      return -1;
+    }
+    SetArrLen(tree->trans, node + 1);
+    SetArrLen(tree->parents, node + 1);
+    SetArrLen(tree->mats, node + 1);
+  }
+  tree->trans[node] = trans;
+  tree->parents[node] = parent;
+  IdentMatFlts(tree->mats[node].m);
+  trans->dirty |= TREE_DIRTY;
+  tree->flags |= DIRTY;
+  return node;
+}
+
+void TransTreeRm(TransTree tree, int node) {
+  int i;
+  if (tree->parents[node] == TREE_FREE) { return; }
+  for (i = 0; i < ArrLen(tree->parents); ++i) {
+    if (tree->parents[i] == node) {
+      tree->parents[i] = -1;
+      tree->trans[i]->dirty |= TREE_DIRTY;
+    }
+  }
+  tree->parents[node] = TREE_FREE;
+  tree->trans[node] = 0;
+  ArrCat(&tree->freeNodes, node);
+  tree->flags |= DIRTY;
+}
+
+int SetTransTreeParent(TransTree tree, int node, int parent) {
+  int p;
+  if (!TransTreeValidParent(tree, parent)) { return 0; }
+  for (p = parent; p >= 0; p = tree->parents[p]) {
+    if (p == node) { return 0; }
+  }
+  tree->parents[node] = parent;
+  tree->trans[node]->dirty |= TREE_DIRTY;
+  tree->flags |= DIRTY;
+  return 1;
+}
+
+int TransTreeParent(TransTree tree, int node) {
+  return tree->parents[node];
+}
+
+Trans TransTreeTrans(TransTree tree, int node) {
+  return tree->trans[node];
+}
+
+Mat TransTreeMat(TransTree tree, int node) {
+  return &tree->mats[node];
+}
+
+/* lay the nodes out depth-first so parents always come before their children. children are
+ * grouped by parent with a counting sort, then walked with an explicit stack */
+static int TransTreeLayout(TransTree tree) {
+  int n = ArrLen(tree->parents);
+  int i, numNodes = 0;
+  if (!FitArr((void**)&tree->childStart, sizeof(int), n + 1) ||
+      !FitArr((void**)&tree->children, sizeof(int), n) ||
+      !FitArr((void**)&tree->pos, sizeof(int), n) ||
+      !FitArr((void**)&tree->stack, sizeof(int), n) ||
+      !FitArr((void**)&tree->order, sizeof(int), n) ||
+      !FitArr((void**)&tree->parentPos, sizeof(int), n) ||
+      !FitArr((void**)&tree->world, sizeof(float), SizeMul(n, 6)) ||
+      !FitArr((void**)&tree->dirty, sizeof(char), n))
+  {
+    return 0;
+  }
+  MemSet(tree->childStart, 0, (n + 1) * sizeof(int));
+  for (i = 0; i < n; ++i) {
+    if (tree->parents[i] >= 0) {
+      ++tree->childStart[tree->parents[i] + 1];
+    }
+  }
+  for (i = 0; i < n; ++i) {
+    tree->childStart[i + 1] += tree->childStart[i];
+  }
+  /* pos is used as the fill cursor for each parent's children here */
+  MemCpy(tree->pos, tree->childStart, n * sizeof(int));
+  for (i = 0; i < n; ++i) {
+    int parent = tree->parents[i];
+    if (parent >= 0) {
+      tree->children[tree->pos[parent]++] = i;
+    }
   }
-  return Pos(mat, -trans->oX, -trans->oY);
-}
-
-Mat ToMat(Trans trans) { return CalcTrans(trans, MkMat(), 0); }
-Mat ToMatOrtho(Trans trans) { return CalcTrans(trans, MkMat(), 1); }
-
-Mat ToTmpMat(Trans trans) {
-  if (trans->dirty & DIRTY) {
-    SetIdentity(trans->tempMat);
-    CalcTrans(trans, trans->tempMat, 0);
-    trans->dirty &= ~DIRTY;
+  for (i = n - 1; i >= 0; --i) {
+    int top = 0, j;
+    if (tree->parents[i] != -1) { continue; }
+    tree->stack[top++] = i;
+    while (top) {
+      int node = tree->stack[--top];
+      int parent = tree->parents[node];
+      tree->pos[node] = numNodes;
+      tree->order[numNodes] = node;
+      tree->parentPos[numNodes] = parent >= 0 ? tree->pos[parent] : -1;
+      ++numNodes;
+      for (j = tree->childStart[node + 1] - 1; j >= tree->childStart[node]; --j) {
+        tree->stack[top++] = tree->children[j];
+      }
+    }
   }
-  return trans->tempMat;
+  SetArrLen(tree->order, numNodes);
+  return 1;
 }
 
-Mat ToTmpMatOrtho(Trans trans) {
-  if (trans->dirty & ORTHO_DIRTY) {
-    SetIdentity(trans->tempMatOrtho);
-    CalcTrans(trans, trans->tempMatOrtho, 1);
-    trans->dirty &= ~ORTHO_DIRTY;
+void UpdTransTree(TransTree tree) {
+  int k, force = 0;
+  if (tree->flags & DIRTY) {
+    if (!TransTreeLayout(tree)) { return; }
+    tree->flags &= ~DIRTY;
+    force = 1; /* world is indexed by position, which just changed */
+  }
+  for (k = 0; k < ArrLen(tree->order); ++k) {
+    int node = tree->order[k];
+    int parent = tree->parentPos[k];
+    Trans trans = tree->trans[node];
+    float* world = &tree->world[k * 6];
+    float* m;
+    tree->dirty[k] = force || (trans->dirty & TREE_DIRTY) || (parent >= 0 && tree->dirty[parent]);
+    if (!tree->dirty[k]) { continue; }
+    trans->dirty &= ~TREE_DIRTY;
+    if (parent >= 0) {
+      float local[6];
+      MatFltsToAff(local, ToTmpMat(trans)->m);
+      MulAffEx(world, &tree->world[parent * 6], local);
+    } else {
+      MatFltsToAff(world, ToTmpMat(trans)->m);
+    }
+    m = tree->mats[node].m;
+    m[ 0] = world[0];
+    m[ 1] = world[1];
+    m[ 4] = world[2];
+    m[ 5] = world[3];
+    m[12] = world[4];
+    m[13] = world[5];
   }
-  return trans->tempMatOrtho;
 }
 
 /* ---------------------------------------------------------------------------------------------- */
@@ -2014,12 +4322,24 @@ void FtMesh(Mesh mesh, Ft ft, int x, int y, char* string) {
   }
 }
 
+/* mesh shared by immediate mode helpers such as PutFt. it's cleared and reused so they don't create
+ * and destroy a mesh on every call */
+static Mesh scratchMesh;
+
+static Mesh ScratchMesh() {
+  if (!scratchMesh) {
+    scratchMesh = MkMesh();
+  } else {
+    ClrMesh(scratchMesh);
+  }
+  return scratchMesh;
+}
+
 void PutFt(Ft ft, int col, int x, int y, char* string) {
-  Mesh mesh = MkMesh();
+  Mesh mesh = ScratchMesh();
   Col(mesh, col);
   FtMesh(mesh, ft, x, y, string);
   PutMesh(mesh, 0, FtImg(ft));
-  RmMesh(mesh);
 }
 
 /* ---------------------------------------------------------------------------------------------- */
@@ -2028,41 +4348,133 @@ float Lerp(float a, float b, float amount) {
   return a * (1 - amount) + b * amount;
 }
 
-void LerpFlts(int n, float* a, float* b, float* c, float amount) {
+FltsImpl
+void LerpFltsImpl(int n, float* a, float* b, float* c, float amount) {
   int i;
   for (i = 0; i < n; ++i) {
     c[i] = Lerp(a[i], b[i], amount);
   }
 }
 
-void MulFltsScalar(int n, float* floats, float* result, float scalar) {
+FltsDispatch(LerpFlts, (int n, float* a, float* b, float* c, float amount), (n, a, b, c, amount))
+
+FltsImpl
+void MulFltsScalarImpl(int n, float* floats, float* result, float scalar) {
   int i;
   for (i = 0; i < n; ++i) {
     result[i] = floats[i] * scalar;
   }
 }
 
-void FloorFlts(int n, float* floats, float* result) {
+FltsDispatch(MulFltsScalar,
+  (int n, float* floats, float* result, float scalar),
+  (n, floats, result, scalar))
+
+/* instead of calling the platform Floor, truncate to int and step down if that went up. floats
+ * with an exponent >= 23 (and inf/nan) are already whole and would overflow the int, so they are
+ * zeroed before the conversion and passed through with a bit mask. the masks and the int compare
+ * result keep gcc from turning the selects into branches, which would stop it from vectorizing */
+FltsImpl
+void FloorFltsImpl(int n, float* floats, float* result) {
   int i;
   for (i = 0; i < n; ++i) {
-    result[i] = Floor(floats[i]);
+    union { float f; int i; } x, c, t;
+    int whole, up;
+    x.f = floats[i];
+    whole = -(((x.i >> 23) & 0xff) >= 127 + 23);
+    c.i = x.i & ~whole;
+    t.f = (float)(int)c.f;
+    up = t.f > c.f;
+    t.f -= (float)up;
+    t.i = (x.i & whole) | (t.i & ~whole);
+    result[i] = t.f;
   }
 }
 
-void ClampFlts(int n, float* floats, float* result, float min, float max) {
+FltsDispatch(FloorFlts, (int n, float* floats, float* result), (n, floats, result))
+
+FltsImpl
+void ClampFltsImpl(int n, float* floats, float* result, float min, float max) {
   int i;
   for (i = 0; i < n; ++i) {
     result[i] = Clamp(floats[i], min, max);
   }
 }
 
-void AddFlts(int n, float* a, float* b, float* result) {
+FltsDispatch(ClampFlts,
+  (int n, float* floats, float* result, float min, float max),
+  (n, floats, result, min, max))
+
+FltsImpl
+void AddFltsImpl(int n, float* a, float* b, float* result) {
   int i;
   for (i = 0; i < n; ++i) {
     result[i] = a[i] + b[i];
   }
 }
 
+FltsDispatch(AddFlts, (int n, float* a, float* b, float* result), (n, a, b, result))
+
+FltsImpl
+void LerpClampFltsImpl(int n, float* a, float* b, float* result, float amount, float min,
+  float max)
+{
+  int i;
+  for (i = 0; i < n; ++i) {
+    float x = Lerp(a[i], b[i], amount);
+    result[i] = Clamp(x, min, max);
+  }
+}
+
+FltsDispatch(LerpClampFlts,
+  (int n, float* a, float* b, float* result, float amount, float min, float max),
+  (n, a, b, result, amount, min, max))
+
+FltsImpl
+void MulAddFltsImpl(int n, float* a, float* b, float* result, float scalar) {
+  int i;
+  for (i = 0; i < n; ++i) {
+    result[i] = a[i] * scalar + b[i];
+  }
+}
+
+FltsDispatch(MulAddFlts,
+  (int n, float* a, float* b, float* result, float scalar),
+  (n, a, b, result, scalar))
+
+#ifdef WEEBCORE_PLATFORM_SINCOS
+void SinCos(float deg, float* s, float* c) {
+  *s = Sin(deg);
+  *c = Cos(deg);
+}
+#else
+/* coefficients are the cephes sinf/cosf minimax polynomials for [-pi/4, pi/4] */
+void SinCos(float deg, float* s, float* c) {
+  float r, x, x2, sn, cs;
+  int q;
+  if (deg - deg != 0) {
+    *s = *c = deg - deg; /* NaN for both NaN and inf, like sinf/cosf */
+    return;
+  }
+  if (deg > 1e8f || deg < -1e8f) {
+    deg = FltMod(deg, 360); /* past this every float is an integer and q would overflow */
+  }
+  q = (int)(deg * (1.0f / 90) + (deg < 0 ? -0.5f : 0.5f));
+  r = deg - q * 90.0f;
+  x = r * (float)(PI / 180);
+  x2 = x * x;
+  sn = x + x * x2 * (-1.6666654611e-1f + x2 * (8.3321608736e-3f + x2 * -1.9515295891e-4f));
+  cs = 1 - 0.5f * x2 + x2 * x2 * (4.166664568298827e-2f + x2 * (-1.388731625493765e-3f +
+    x2 * 2.443315711809948e-5f));
+  switch (q & 3) {
+    case 0: *s = sn; *c = cs; break;
+    case 1: *s = cs; *c = -sn; break;
+    case 2: *s = -sn; *c = -cs; break;
+    default: *s = -cs; *c = sn; break;
+  }
+}
+#endif
+
 void CpyRect(float* dst, float* src) {
   SetRect(dst, src[0], src[1], src[2], src[3]);
 }
@@ -2124,6 +4536,96 @@ int RectInRectArea(float* needle, float* haystack) {
   );
 }
 
+/* each word of bits is built from up to 32 rects. the tests use & instead of && so there are no
+ * branches, and each result is turned into its bit by masking rectBits[i] rather than shifting by
+ * i, since sse2 has no per-lane variable shift and the loop wouldn't vectorize */
+
+static unsigned rectBits[32] = {
+  1u<<0, 1u<<1, 1u<<2, 1u<<3, 1u<<4, 1u<<5, 1u<<6, 1u<<7, 1u<<8, 1u<<9, 1u<<10, 1u<<11, 1u<<12,
+  1u<<13, 1u<<14, 1u<<15, 1u<<16, 1u<<17, 1u<<18, 1u<<19, 1u<<20, 1u<<21, 1u<<22, 1u<<23,
+  1u<<24, 1u<<25, 1u<<26, 1u<<27, 1u<<28, 1u<<29, 1u<<30, 1u<<31
+};
+
+FltsImpl
+void RectsSectRectImpl(float* rects, int n, float* query, int* outBits) {
+  float* lefts = rects;
+  float* rights = rects + n;
+  float* tops = rects + n * 2;
+  float* bots = rects + n * 3;
+  float left = query[0], right = query[1], top = query[2], bot = query[3];
+  int base;
+  for (base = 0; base < n; base += 32) {
+    float* l = lefts + base;
+    float* r = rights + base;
+    float* t = tops + base;
+    float* b = bots + base;
+    int i, len = Min(n - base, 32);
+    unsigned word = 0;
+    for (i = 0; i < len; ++i) {
+      unsigned sect = (l[i] < right) & (r[i] >= left) & (t[i] < bot) & (b[i] >= top);
+      word |= rectBits[i] & (0u - sect);
+    }
+    outBits[base / 32] = (int)word;
+  }
+}
+
+FltsDispatch(RectsSectRect,
+  (float* rects, int n, float* query, int* outBits),
+  (rects, n, query, outBits))
+
+FltsImpl
+void RectsContainPtImpl(float* rects, int n, float x, float y, int* outBits) {
+  float* lefts = rects;
+  float* rights = rects + n;
+  float* tops = rects + n * 2;
+  float* bots = rects + n * 3;
+  int base;
+  for (base = 0; base < n; base += 32) {
+    float* l = lefts + base;
+    float* r = rights + base;
+    float* t = tops + base;
+    float* b = bots + base;
+    int i, len = Min(n - base, 32);
+    unsigned word = 0;
+    for (i = 0; i < len; ++i) {
+      unsigned in = (x >= l[i]) & (x < r[i]) & (y >= t[i]) & (y < b[i]);
+      word |= rectBits[i] & (0u - in);
+    }
+    outBits[base / 32] = (int)word;
+  }
+}
+
+FltsDispatch(RectsContainPt,
+  (float* rects, int n, float x, float y, int* outBits),
+  (rects, n, x, y, outBits))
+
+FltsImpl
+void RectsInRectImpl(float* rects, int n, float* haystack, int* outBits) {
+  float* lefts = rects;
+  float* rights = rects + n;
+  float* tops = rects + n * 2;
+  float* bots = rects + n * 3;
+  float left = haystack[0], right = haystack[1], top = haystack[2], bot = haystack[3];
+  int base;
+  for (base = 0; base < n; base += 32) {
+    float* l = lefts + base;
+    float* r = rights + base;
+    float* t = tops + base;
+    float* b = bots + base;
+    int i, len = Min(n - base, 32);
+    unsigned word = 0;
+    for (i = 0; i < len; ++i) {
+      unsigned in = (l[i] >= left) & (r[i] <= right) & (t[i] >= top) & (b[i] <= bot);
+      word |= rectBits[i] & (0u - in);
+    }
+    outBits[base / 32] = (int)word;
+  }
+}
+
+FltsDispatch(RectsInRect,
+  (float* rects, int n, float* haystack, int* outBits),
+  (rects, n, haystack, outBits))
+
 void SetRectLeft(float* rect, float left)   { rect[0] = left; }
 void SetRectRight(float* rect, float right) { rect[1] = right; }
 void SetRectTop(float* rect, float top) { rect[2] = top; }
@@ -2139,13 +4641,15 @@ float RectBot(float* rect) { return rect[3]; }
 
 /* ---------------------------------------------------------------------------------------------- */
 
-/* memory layout:
- * float left_axis[4]; float up_axis[4]; float fwd_axis[4]; float translation[4]; */
-
-struct _Mat { float m[16]; };
+static Pool matPool;
 
 Mat MkMat() {
-  Mat mat = Alloc(sizeof(struct _Mat));
+  Mat mat;
+  if (!matPool) {
+    matPool = MkPool(sizeof(struct _Mat));
+    SetPoolName(matPool, "Mat");
+  }
+  mat = PoolAlloc(matPool);
   if (mat) {
     mat->m[0] = mat->m[5] = mat->m[10] = mat->m[15] = 1;
   }
@@ -2153,7 +4657,7 @@ Mat MkMat() {
 }
 
 void RmMat(Mat mat) {
-  Free(mat);
+  PoolFree(matPool, mat);
 }
 
 Mat DupMat(Mat source) {
@@ -2162,8 +4666,7 @@ Mat DupMat(Mat source) {
 
 /* these return mat for convienience. it's not actually a copy */
 Mat SetIdentity(Mat mat) {
-  MemSet(mat->m, 0, sizeof(mat->m));
-  mat->m[0] = mat->m[5] = mat->m[10] = mat->m[15] = 1;
+  IdentMatFlts(mat->m);
   return mat;
 }
 
@@ -2192,10 +4695,8 @@ float* MatFlts(Mat mat) {
 }
 
 Mat Scale(Mat mat, float x, float y) {
-  float m[16] = MAT_IDENT;
-  m[0] = x;
-  m[5] = y;
-  return MulMatFlt(mat, m);
+  ScaleMatFlts(mat->m, x, y);
+  return mat;
 }
 
 Mat Scale1(Mat mat, float scale) {
@@ -2203,41 +4704,203 @@ Mat Scale1(Mat mat, float scale) {
 }
 
 Mat Pos(Mat mat, float x, float y) {
-  float m[16] = MAT_IDENT;
-  m[12] = x;
-  m[13] = y;
-  return MulMatFlt(mat, m);
+  PosMatFlts(mat->m, x, y);
+  return mat;
 }
 
 Mat Rot(Mat mat, float deg) {
-  /* 2d rotation = z axis rotation. this means we rotate the left and up axes */
-  float s = Sin(deg);
-  float m[16] = MAT_IDENT;
-  m[0] = m[5] = Cos(deg);
-  m[1] = s;
-  m[4] = -s;
-  return MulMatFlt(mat, m);
+  RotMatFlts(mat->m, deg);
+  return mat;
 }
 
 Mat MulMat(Mat mat, Mat other) {
   return MulMatFlt(mat, other->m);
 }
 
-Mat MulMatFlt(Mat mat, float* matIn) {
-  Mat tmp = MkMulMatFlt(mat, matIn);
-  SetMat(mat, tmp->m);
-  RmMat(tmp);
-  return mat;
+void IdentMatFlts(float* m) {
+  MemSet(m, 0, sizeof(float) * 16);
+  m[0] = m[5] = m[10] = m[15] = 1;
 }
 
-Mat MkMulMat(Mat matA, Mat matB) {
-  return MkMulMatFlt(matA, matB->m);
+/* these are other * m where other is a scale, translation or rotation mat, expanded by hand. each
+ * row of other that isn't identity becomes a combination of the rows of m */
+
+void ScaleMatFlts(float* m, float x, float y) {
+  int i;
+  for (i = 0; i < 4; ++i) {
+    m[i] *= x;
+    m[4 + i] *= y;
+  }
 }
 
-Mat MkMulMatFlt(Mat matA, float* b) {
-  Mat res = MkMat();
-  float* a = matA->m;
-  float* m = res->m;
+void PosMatFlts(float* m, float x, float y) {
+  int i;
+  for (i = 0; i < 4; ++i) {
+    m[12 + i] += x * m[i] + y * m[4 + i];
+  }
+}
+
+void RotMatFlts(float* m, float deg) {
+  /* 2d rotation = z axis rotation. this means we rotate the left and up axes */
+  float s, c;
+  int i;
+  SinCos(deg, &s, &c);
+  for (i = 0; i < 4; ++i) {
+    float left = m[i], up = m[4 + i];
+    m[i] = c * left + s * up;
+    m[4 + i] = c * up - s * left;
+  }
+}
+
+void MulMatFlts(float* m, float* other) {
+  float tmp[16];
+  MulMatFltsEx(tmp, m, other);
+  MemCpy(m, tmp, sizeof(tmp));
+}
+
+/* this is the { x, y, 0, 1 } row of a full mat multiply with all the zero terms dropped */
+void TransPtFlts(float* m, float* point) {
+  float x = point[0], y = point[1];
+  point[0] = x * m[0] + y * m[4] + m[12];
+  point[1] = x * m[1] + y * m[5] + m[13];
+}
+
+void InvTransPtFlts(float* m, float* point) {
+  /* https://en.wikibooks.org/wiki/GLSL_Programming/Applying_Matrix_Transformations#Transforming_Pts_with_the_Inverse_Matrix */
+  float x = point[0] - m[12], y = point[1] - m[13];
+  /* the inverse of an orthogonal 2x2 is its transpose */
+  point[0] = x * m[0] + y * m[1];
+  point[1] = x * m[4] + y * m[5];
+}
+
+void IdentAff(float* aff) {
+  aff[0] = aff[3] = 1;
+  aff[1] = aff[2] = aff[4] = aff[5] = 0;
+}
+
+/* same row tricks as the Flts versions. { a, b } is the left axis, { c, d } is the up axis */
+
+void ScaleAff(float* aff, float x, float y) {
+  aff[0] *= x;
+  aff[1] *= x;
+  aff[2] *= y;
+  aff[3] *= y;
+}
+
+void PosAff(float* aff, float x, float y) {
+  aff[4] += x * aff[0] + y * aff[2];
+  aff[5] += x * aff[1] + y * aff[3];
+}
+
+void RotAff(float* aff, float deg) {
+  float s, c;
+  float a = aff[0], b = aff[1];
+  SinCos(deg, &s, &c);
+  aff[0] = c * a + s * aff[2];
+  aff[1] = c * b + s * aff[3];
+  aff[2] = c * aff[2] - s * a;
+  aff[3] = c * aff[3] - s * b;
+}
+
+void MulAffEx(float* r, float* a, float* b) {
+  r[0] = b[0] * a[0] + b[1] * a[2];
+  r[1] = b[0] * a[1] + b[1] * a[3];
+  r[2] = b[2] * a[0] + b[3] * a[2];
+  r[3] = b[2] * a[1] + b[3] * a[3];
+  r[4] = b[4] * a[0] + b[5] * a[2] + a[4];
+  r[5] = b[4] * a[1] + b[5] * a[3] + a[5];
+}
+
+void MulAff(float* aff, float* other) {
+  float tmp[6];
+  MulAffEx(tmp, aff, other);
+  aff[0] = tmp[0];
+  aff[1] = tmp[1];
+  aff[2] = tmp[2];
+  aff[3] = tmp[3];
+  aff[4] = tmp[4];
+  aff[5] = tmp[5];
+}
+
+void TransPtAff(float* aff, float* point) {
+  float x = point[0], y = point[1];
+  point[0] = x * aff[0] + y * aff[2] + aff[4];
+  point[1] = x * aff[1] + y * aff[3] + aff[5];
+}
+
+/* inverse of the 2x2 part is the adjugate over the determinant, then the translation is undone by
+ * running it through the inverted 2x2 and negating it */
+int InvAff(float* result, float* aff) {
+  float det = aff[0] * aff[3] - aff[1] * aff[2];
+  float a, b, c, d;
+  if (det == 0) {
+    return 0;
+  }
+  det = 1 / det;
+  a =  aff[3] * det;
+  b = -aff[1] * det;
+  c = -aff[2] * det;
+  d =  aff[0] * det;
+  result[4] = -(aff[4] * a + aff[5] * c);
+  result[5] = -(aff[4] * b + aff[5] * d);
+  result[0] = a;
+  result[1] = b;
+  result[2] = c;
+  result[3] = d;
+  return 1;
+}
+
+void InvTransPtAff(float* aff, float* point) {
+  float inv[6];
+  if (InvAff(inv, aff)) {
+    TransPtAff(inv, point);
+  }
+}
+
+/* the coefficients are copied to locals so the compiler knows the stores don't change them. with
+ * that, gcc and clang turn both loops into simd at -O3 */
+
+void TransPtsAff(float* aff, float* xy, int n) {
+  float a = aff[0], b = aff[1], c = aff[2], d = aff[3], tx = aff[4], ty = aff[5];
+  int i;
+  for (i = 0; i < n; ++i) {
+    float x = xy[i * 2], y = xy[i * 2 + 1];
+    xy[i * 2] = x * a + y * c + tx;
+    xy[i * 2 + 1] = x * b + y * d + ty;
+  }
+}
+
+void TransPtsAffSoA(float* aff, float* xs, float* ys, int n) {
+  float a = aff[0], b = aff[1], c = aff[2], d = aff[3], tx = aff[4], ty = aff[5];
+  int i;
+  for (i = 0; i < n; ++i) {
+    float x = xs[i], y = ys[i];
+    xs[i] = x * a + y * c + tx;
+    ys[i] = x * b + y * d + ty;
+  }
+}
+
+void AffToMatFlts(float* m, float* aff) {
+  IdentMatFlts(m);
+  m[ 0] = aff[0];
+  m[ 1] = aff[1];
+  m[ 4] = aff[2];
+  m[ 5] = aff[3];
+  m[12] = aff[4];
+  m[13] = aff[5];
+}
+
+void MatFltsToAff(float* aff, float* m) {
+  aff[0] = m[ 0];
+  aff[1] = m[ 1];
+  aff[2] = m[ 4];
+  aff[3] = m[ 5];
+  aff[4] = m[12];
+  aff[5] = m[13];
+}
+
+/* m = b * a. m must not alias a or b */
+void MulMatFltsEx(float* m, float* a, float* b) {
   m[ 0] = b[ 0] * a[0] + b[ 1] * a[4] + b[ 2] * a[ 8] + b[ 3] * a[12];
   m[ 1] = b[ 0] * a[1] + b[ 1] * a[5] + b[ 2] * a[ 9] + b[ 3] * a[13];
   m[ 2] = b[ 0] * a[2] + b[ 1] * a[6] + b[ 2] * a[10] + b[ 3] * a[14];
@@ -2254,29 +4917,65 @@ Mat MkMulMatFlt(Mat matA, float* b) {
   m[13] = b[12] * a[1] + b[13] * a[5] + b[14] * a[ 9] + b[15] * a[13];
   m[14] = b[12] * a[2] + b[13] * a[6] + b[14] * a[10] + b[15] * a[14];
   m[15] = b[12] * a[3] + b[13] * a[7] + b[14] * a[11] + b[15] * a[15];
+}
+
+Mat MulMatFlt(Mat mat, float* matIn) {
+  MulMatFlts(mat->m, matIn);
+  return mat;
+}
+
+Mat MkMulMat(Mat matA, Mat matB) {
+  return MkMulMatFlt(matA, matB->m);
+}
+
+Mat MkMulMatFlt(Mat matA, float* b) {
+  Mat res = MkMat();
+  if (res) {
+    MulMatFltsEx(res->m, matA->m, b);
+  }
   return res;
 }
 
 void TransPt(Mat mat, float* point) {
-  float mPt[16];
-  Mat tmp;
-  MemSet(mPt, 0, sizeof(mPt));
-  MemCpy(mPt, point, sizeof(float) * 2);
-  mPt[3] = 1;
-  tmp = MkMulMatFlt(mat, mPt);
-  MemCpy(point, tmp->m, sizeof(float) * 2);
-  RmMat(tmp);
+  TransPtFlts(mat->m, point);
 }
 
 void InvTransPt(Mat mat, float* point) {
-  /* https://en.wikibooks.org/wiki/GLSL_Programming/Applying_Matrix_Transformations#Transforming_Pts_with_the_Inverse_Matrix */
-  Mat tmp = DupMat(mat);
-  float* m = tmp->m;
-  point[0] -= m[12];
-  point[1] -= m[13];
-  m[12] = m[13] = m[14] = m[15] = m[3] = m[7] = m[11] = 0; /* equivalent of taking the 3x3 mat */
-  TransPt(tmp, point);
-  RmMat(tmp);
+  InvTransPtFlts(mat->m, point);
+}
+
+/* InvTransPtFlts as an affine: the transposed 2x2, with the translation moved through it */
+static void InvOrthoAff(float* aff, float* m) {
+  aff[0] = m[0];
+  aff[1] = m[4];
+  aff[2] = m[1];
+  aff[3] = m[5];
+  aff[4] = -(m[12] * m[0] + m[13] * m[1]);
+  aff[5] = -(m[12] * m[4] + m[13] * m[5]);
+}
+
+void TransPts(Mat mat, float* xy, int n) {
+  float aff[6];
+  MatFltsToAff(aff, mat->m);
+  TransPtsAff(aff, xy, n);
+}
+
+void TransPtsSoA(Mat mat, float* xs, float* ys, int n) {
+  float aff[6];
+  MatFltsToAff(aff, mat->m);
+  TransPtsAffSoA(aff, xs, ys, n);
+}
+
+void InvTransPts(Mat mat, float* xy, int n) {
+  float aff[6];
+  InvOrthoAff(aff, mat->m);
+  TransPtsAff(aff, xy, n);
+}
+
+void InvTransPtsSoA(Mat mat, float* xs, float* ys, int n) {
+  float aff[6];
+  InvOrthoAff(aff, mat->m);
+  TransPtsAffSoA(aff, xs, ys, n);
 }
 
 /* ---------------------------------------------------------------------------------------------- */
@@ -2302,7 +5001,9 @@ static int PaletteIndex(int** palette, int color) {
 
 void CatSprHdr(char** pArr, int formatVersion, int width, int height, int* palette) {
   int i;
-  ArrStrCat(pArr, "WBSP");
+  /* magic + 4 varints + palette, so the palette loop never grows the arr */
+  ArrReserve(pArr, 4 + 4 * 5 + ArrLen(palette) * 4);
+  ArrCatN(pArr, "WBSP", 4);
   CatVarI32(pArr, formatVersion);
   CatVarI32(pArr, width);
   CatVarI32(pArr, height);
@@ -2349,14 +5050,21 @@ int SprHeight(Spr spr) {
   return spr->height;
 }
 
+static Pool sprPool;
+
 Spr MkSpr(char* data, int length) {
   char* p = data;
   int paletteSize, i, dataLen;
-  Spr spr = Alloc(sizeof(struct _Spr));
+  Spr spr;
   if (MemCmp(p, "WBSP", 4)) {
     /* TODO: error codes or something */
     return 0;
   }
+  if (!sprPool) {
+    sprPool = MkPool(sizeof(struct _Spr));
+    SetPoolName(sprPool, "Spr");
+  }
+  spr = PoolAlloc(sprPool);
   p += 4;
   DecVarI32(&p); /* format version */
   spr->width = DecVarI32(&p);
@@ -2376,11 +5084,13 @@ Spr MkSprFromArr(char* data) {
 }
 
 Spr MkSprFromFile(char* filePath) {
-  int len = 1024000; /* TODO: handle bigger files */
-  char* data = Alloc(len);
-  Spr res;
-  len = RdFile(filePath, data, len);
-  res = len >= 0 ? MkSpr(data, len) : 0;
+  int len = FileSize(filePath);
+  char* data = len >= 0 ? AllocRaw(Max(len, 1)) : 0;
+  Spr res = 0;
+  if (data) {
+    len = RdFile(filePath, data, len);
+    res = len >= 0 ? MkSpr(data, len) : 0;
+  }
   Free(data);
   return res;
 }
@@ -2411,8 +5121,9 @@ void SprToArgb(Spr spr, int* argb) {
 
 int* SprToArgbArr(Spr spr) {
   int* res = 0;
-  ArrAlloc(&res, spr->width * spr->height);
-  SprToArgb(spr, res);
+  if (ArrAlloc(&res, SizeMul(spr->width, spr->height))) {
+    SprToArgb(spr, res);
+  }
   return res;
 }
 
@@ -2421,7 +5132,253 @@ void RmSpr(Spr spr) {
     RmArr(spr->palette);
     RmArr(spr->data);
   }
-  Free(spr);
+  PoolFree(sprPool, spr);
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+/* memory diagnostics wrap whatever allocator is installed when the app starts. allocations are
+ * tracked in a ptr Map instead of a header in front of the memory, so memory allocated before the
+ * wrapper was installed (or by a different allocator) can still be freed safely, it's just not
+ * counted. our own bookkeeping allocations are made with busy set so they are not tracked either */
+
+#ifdef WEEBCORE_MEMDIAG
+
+typedef struct _MemStats {
+  char* tag;
+  Sz bytes, peak;
+  int live;
+} MemStats;
+
+typedef struct _MemRec {
+  MemStats* stats;
+  Sz size;
+} MemRec;
+
+static struct _MemDiag {
+  AllocFunc* alloc;
+  AllocFunc* zalloc;
+  ReallocFunc* realloc;
+  FreeFunc* free;
+  void* user;
+  int busy;
+  Map recs;        /* ptr -> MemRec */
+  Pool recPool;
+  Hash stats;      /* tag -> MemStats */
+  MemStats** tags; /* all the MemStats, for iterating and sorting */
+  MemStats total;
+  char* text;
+} memDiag;
+
+/* n is 1 to add an allocation of size bytes and -1 to remove it */
+static void MemStatsAdd(MemStats* stats, Sz bytes, int n) {
+  stats->bytes = n > 0 ? stats->bytes + bytes : stats->bytes - bytes;
+  stats->live += n;
+  stats->peak = Max(stats->peak, stats->bytes);
+}
+
+static void MemTrack(void* p, Sz n, char* tag) {
+  MemStats* stats;
+  MemRec* rec;
+  if (!p || memDiag.busy) {
+    return;
+  }
+  memDiag.busy = 1;
+  if (!memDiag.recs) {
+    memDiag.recs = MkPtrMap();
+    memDiag.recPool = MkPool(sizeof(MemRec));
+    memDiag.stats = MkHash();
+  }
+  tag = tag ? tag : "untagged";
+  stats = HashGet(memDiag.stats, tag);
+  if (!stats) {
+    stats = Alloc(sizeof(MemStats));
+    stats->tag = tag;
+    HashSet(memDiag.stats, tag, stats);
+    ArrCat(&memDiag.tags, stats);
+  }
+  rec = PoolAlloc(memDiag.recPool);
+  rec->stats = stats;
+  rec->size = n;
+  MapSetp(memDiag.recs, p, rec);
+  MemStatsAdd(stats, n, 1);
+  MemStatsAdd(&memDiag.total, n, 1);
+  memDiag.busy = 0;
+}
+
+/* Map has no removal so the key stays with a NULL val until the address is reused. once the freed
+ * keys outnumber the live allocations the map is pruned so it doesn't grow forever */
+static MemStats* MemUntrack(void* p) {
+  MemRec* rec = p && memDiag.recs ? MapGetp(memDiag.recs, p) : 0;
+  MemStats* stats = 0;
+  if (rec && !memDiag.busy) {
+    memDiag.busy = 1;
+    stats = rec->stats;
+    MapSetp(memDiag.recs, p, 0);
+    MemStatsAdd(stats, rec->size, -1);
+    MemStatsAdd(&memDiag.total, rec->size, -1);
+    PoolFree(memDiag.recPool, rec);
+    if (MapNumKeys(memDiag.recs) - memDiag.total.live > Max(memDiag.total.live, 1024)) {
+      MapPrune(memDiag.recs);
+    }
+    memDiag.busy = 0;
+  }
+  return stats;
+}
+
+static char* MemDiagConsumeTag() {
+  char* tag = memDiagTag;
+  memDiagTag = 0;
+  return tag;
+}
+
+static void* MemDiagAlloc(void* user, Sz n) {
+  char* tag = MemDiagConsumeTag();
+  void* p = memDiag.alloc(memDiag.user, n);
+  MemTrack(p, n, tag);
+  return p;
+}
+
+static void* MemDiagZAlloc(void* user, Sz n) {
+  char* tag = MemDiagConsumeTag();
+  void* p;
+  if (memDiag.zalloc) {
+    p = memDiag.zalloc(memDiag.user, n);
+  } else {
+    p = memDiag.alloc(memDiag.user, n);
+    if (p) {
+      MemSetSz(p, 0, n);
+    }
+  }
+  MemTrack(p, n, tag);
+  return p;
+}
+
+static void* MemDiagRealloc(void* user, void* p, Sz n) {
+  char* tag = MemDiagConsumeTag();
+  void* res = memDiag.realloc(memDiag.user, p, n);
+  if (res) {
+    /* keep the tag of the original allocation */
+    MemStats* stats = MemUntrack(p);
+    MemTrack(res, n, stats ? stats->tag : tag);
+  }
+  return res;
+}
+
+static void MemDiagFree(void* user, void* p) {
+  MemDiagConsumeTag();
+  MemUntrack(p);
+  memDiag.free(memDiag.user, p);
+}
+
+static void MkMemDiag() {
+  GetAllocator(&memDiag.alloc, &memDiag.zalloc, &memDiag.realloc, &memDiag.free, &memDiag.user);
+  memDiagTag = 0;
+  SetAllocator(MemDiagAlloc, MemDiagZAlloc, MemDiagRealloc, MemDiagFree, 0);
+}
+
+static void ArrStrCatSz(char** pArr, Sz x) {
+  char buf[24];
+  char* p = buf + sizeof(buf);
+  do {
+    *--p = '0' + (char)(x % 10);
+    x /= 10;
+  } while (x);
+  ArrStrCatN(pArr, p, (int)(buf + sizeof(buf) - p));
+}
+
+static void ArrStrCatMemStats(char** pArr, MemStats* stats) {
+  ArrStrCat(pArr, stats->tag);
+  ArrStrCat(pArr, ": ");
+  ArrStrCatSz(pArr, stats->bytes);
+  ArrStrCat(pArr, " bytes in ");
+  ArrStrCatI32(pArr, stats->live, 10);
+  ArrStrCat(pArr, " allocs, peak ");
+  ArrStrCatSz(pArr, stats->peak);
+}
+
+static void RmMemDiag() {
+  int i;
+  char* line = 0;
+  memDiag.busy = 1; /* don't count the report's own line buffer */
+  for (i = 0; i < ArrLen(memDiag.tags); ++i) {
+    MemStats* stats = memDiag.tags[i];
+    if (stats->live) {
+      SetArrLen(line, 0);
+      ArrStrCat(&line, "leak: ");
+      ArrStrCatMemStats(&line, stats);
+      ArrCat(&line, 0);
+      Log(line);
+    }
+  }
+  RmArr(line);
+  SetAllocator(memDiag.alloc, memDiag.zalloc, memDiag.realloc, memDiag.free, memDiag.user);
+  for (i = 0; i < ArrLen(memDiag.tags); ++i) {
+    Free(memDiag.tags[i]);
+  }
+  RmArr(memDiag.tags);
+  RmArr(memDiag.text);
+  RmMap(memDiag.recs);
+  if (memDiag.recPool) {
+    memDiag.recPool->live = 0; /* the recs left are the leaks we just logged */
+  }
+  RmPool(memDiag.recPool);
+  RmHash(memDiag.stats);
+  MemSet(&memDiag, 0, sizeof(memDiag));
+}
+
+static int CmpMemStats(void* a, void* b) {
+  Sz x = ((MemStats*)a)->bytes, y = ((MemStats*)b)->bytes;
+  return (x < y) - (x > y);
+}
+
+static void PutMemDiagText() {
+  int i;
+  char* s = memDiag.text;
+  SetArrLen(s, 0);
+  ArrStrCat(&s, "MemDiag - ");
+  ArrStrCatSz(&s, memDiag.total.bytes);
+  ArrStrCat(&s, " bytes in ");
+  ArrStrCatI32(&s, memDiag.total.live, 10);
+  ArrStrCat(&s, " allocs, peak ");
+  ArrStrCatSz(&s, memDiag.total.peak);
+  ArrStrCat(&s, "\n\n");
+  Qsort((void**)memDiag.tags, ArrLen(memDiag.tags), CmpMemStats);
+  for (i = 0; i < ArrLen(memDiag.tags); ++i) {
+    ArrStrCatMemStats(&s, memDiag.tags[i]);
+    ArrCat(&s, '\n');
+  }
+  ArrCat(&s, 0);
+  PutFt(DefFt(), 0xbebebe, 10, 10, s);
+  memDiag.text = s;
+}
+
+#else
+
+static void MkMemDiag() { }
+static void RmMemDiag() { }
+
+static void PutMemDiagText() {
+  PutFt(DefFt(), 0xbebebe, 10, 10, "MemDiag - build WeebCore with -DWEEBCORE_MEMDIAG to enable");
+}
+
+#endif /* WEEBCORE_MEMDIAG */
+
+static void DiagMemFrame() {
+  /* black background */
+  Mesh mesh = ScratchMesh();
+  Col(mesh, 0x000000);
+  Quad(mesh, 0, 0, WndWidth(AppWnd()), WndHeight(AppWnd()));
+  PutMesh(mesh, 0, 0);
+  PutMemDiagText();
+}
+
+void DiagMem(int enabled) {
+  if (enabled) {
+    On(FRAME, DiagMemFrame);
+  } else {
+    RmHandler(FRAME, DiagMemFrame);
+  }
 }
 
 /* ---------------------------------------------------------------------------------------------- */
@@ -2457,6 +5414,16 @@ static struct _Globals {
   float flushTimer;
 
   int diagPage;
+  char* diagText;
+
+  /* frame memory. allocations that don't fit in frameMem spill to the heap and frameMem is grown
+   * to the peak usage at the end of the frame, so it stops spilling after a couple frames. it's
+   * shrunk back when the peak stays low for a while */
+  char* frameMem;
+  char** frameSpills;
+  int* frameSpillMarks; /* frameUsed when each spill was made */
+  int frameUsed, framePeak, frameCap;
+  int frameLowFrames, frameLowPeak;
 } app;
 
 Wnd AppWnd() { return app.wnd; }
@@ -2506,6 +5473,95 @@ void RmHandler(int msg, AppHandler handler) {
   }
 }
 
+/* keep frame allocations aligned for SIMD loads */
+#define FRAME_ALIGN 16
+
+/* frameMem doesn't grow past this, bigger peaks keep spilling to the heap */
+#define FRAME_MAX_CAP (64 * 1024 * 1024)
+
+/* shrink frameMem once the peak stayed under a quarter of it for this many frames */
+#define FRAME_DECAY_FRAMES 300
+
+void* FrameAlloc(int n) {
+  void* res;
+  if (n < 0 || n > 0x7fffffff - FRAME_ALIGN - app.frameUsed) {
+    return 0;
+  }
+  n = AlignUpToPowerOfTwo(Max(n, 1), FRAME_ALIGN);
+  if (n <= app.frameCap - app.frameUsed) {
+    res = app.frameMem + app.frameUsed;
+  } else {
+    int len = ArrLen(app.frameSpills);
+    res = AllocRawTagged("Frame", n);
+    if (!res) {
+      return 0;
+    }
+    ArrCat(&app.frameSpills, res);
+    ArrCat(&app.frameSpillMarks, app.frameUsed);
+    if (ArrLen(app.frameSpills) != len + 1 || ArrLen(app.frameSpillMarks) != len + 1) {
+      SetArrLen(app.frameSpills, len);
+      SetArrLen(app.frameSpillMarks, len);
+      Free(res);
+      return 0;
+    }
+  }
+  app.frameUsed += n;
+  app.framePeak = Max(app.framePeak, app.frameUsed);
+  return res;
+}
+
+int FrameMark() { return app.frameUsed; }
+
+/* spills are made in order so the ones above the mark are at the end */
+void FrameRewind(int mark) {
+  int n = ArrLen(app.frameSpills);
+  while (n > 0 && app.frameSpillMarks[n - 1] >= mark) {
+    Free(app.frameSpills[--n]);
+  }
+  SetArrLen(app.frameSpills, n);
+  SetArrLen(app.frameSpillMarks, n);
+  app.frameUsed = Min(mark, app.frameUsed);
+}
+
+static void ClrFrameMem() {
+  int i, cap = app.frameCap;
+  for (i = 0; i < ArrLen(app.frameSpills); ++i) {
+    Free(app.frameSpills[i]);
+  }
+  SetArrLen(app.frameSpills, 0);
+  SetArrLen(app.frameSpillMarks, 0);
+  /* check the peak rather than the spills, FrameRewind might have released them already */
+  if (app.framePeak > app.frameCap) {
+    cap = RoundUpToPowerOfTwo(Min(app.framePeak, FRAME_MAX_CAP));
+  } else if (app.framePeak < app.frameCap / 4) {
+    app.frameLowPeak = Max(app.frameLowPeak, app.framePeak);
+    if (++app.frameLowFrames >= FRAME_DECAY_FRAMES) {
+      cap = RoundUpToPowerOfTwo(app.frameLowPeak);
+    }
+  } else {
+    app.frameLowFrames = app.frameLowPeak = 0;
+  }
+  if (cap != app.frameCap) {
+    Free(app.frameMem);
+    app.frameMem = cap ? AllocRawTagged("Frame", cap) : 0;
+    app.frameCap = app.frameMem ? cap : 0;
+    app.frameLowFrames = app.frameLowPeak = 0;
+  }
+  app.frameUsed = app.framePeak = 0;
+}
+
+static void RmFrameMem() {
+  ClrFrameMem();
+  RmArr(app.frameSpills);
+  RmArr(app.frameSpillMarks);
+  Free(app.frameMem);
+  app.frameSpills = 0;
+  app.frameSpillMarks = 0;
+  app.frameMem = 0;
+  app.frameCap = 0;
+  app.frameLowFrames = app.frameLowPeak = 0;
+}
+
 void SetAppName(char* name) { app.name = name; }
 void SetAppClass(char* class) { app.class = class; }
 void SetAppPageSize(int pageSize) { app.pageSize = pageSize; }
@@ -2601,6 +5657,7 @@ void ClrImgs() {
 }
 
 void MkApp(int argc, char* argv[]) {
+  MkMemDiag();
   app.argc = argc;
   app.argv = argv;
   app.pageSize = app.pageSize ? RoundUpToPowerOfTwo(app.pageSize) : 1024;
@@ -2613,6 +5670,16 @@ void MkApp(int argc, char* argv[]) {
   FlushImgs();
 }
 
+/* the handle pools are made lazily by the first Mk* call. any handle still alive becomes invalid */
+static void RmHandlePools() {
+  RmPool(transPool);
+  RmPool(matPool);
+  RmPool(sprPool);
+  transPool = 0;
+  matPool = 0;
+  sprPool = 0;
+}
+
 void RmApp() {
   int i;
   AppHandle(QUIT);
@@ -2620,6 +5687,15 @@ void RmApp() {
   for (i = 0; i < LAST_MSG_TYPE; ++i) {
     RmArr(app.handlers[i]);
   }
+  RmMesh(scratchMesh);
+  scratchMesh = 0;
+  RmArr(app.diagText);
+  app.diagText = 0;
+  RmFrameMem();
+  RmHandlePools();
+  RmWnd(app.wnd);
+  app.wnd = 0;
+  RmMemDiag();
 }
 
 int AppHandleMsg() {
@@ -2639,6 +5715,7 @@ void AppFrame() {
     FlushImgs();
     app.flushTimer = 0;
   }
+  ClrFrameMem();
 }
 
 int AppRunning() { return app.flags & RUNNING; }
@@ -2671,7 +5748,7 @@ ImgPtr ImgAlloc(int width, int height) {
     /* no free pages, make a new page */
     page = ArrAlloc(&app.pages, 1);
     page->img = MkImg();
-    page->pixs = Alloc(app.pageSize * app.pageSize * sizeof(int));
+    page->pixs = AllocTagged("ImgPage", app.pageSize * app.pageSize * sizeof(int));
     page->pak = MkPacker(app.pageSize, app.pageSize);
     if (!Pack(page->pak, r)) {
       return 0;
@@ -2759,6 +5836,16 @@ void ImgFree(ImgPtr img) {
   region->page = -1;
 }
 
+void PutMeshAff(Mesh mesh, float* aff, ImgPtr ptr) {
+  struct _Mat mat;
+  if (aff) {
+    AffToMatFlts(mat.m, aff);
+  } else {
+    IdentMatFlts(mat.m);
+  }
+  PutMesh(mesh, &mat, ptr);
+}
+
 void PutMesh(Mesh mesh, Mat mat, ImgPtr ptr) {
   if (ptr) {
     ImgRegion* region = &app.regions[ptr - 1];
@@ -2785,7 +5872,9 @@ static void DiagImgAllocKeyDown() {
 }
 
 static void PutPageText() {
-  char* pagestr = 0;
+  char* pagestr;
+  SetArrLen(app.diagText, 0);
+  pagestr = app.diagText;
   ArrStrCat(&pagestr, "ImgAllocator Diag - page ");
   ArrStrCatI32(&pagestr, app.diagPage + 1, 10);
   ArrCat(&pagestr, '/');
@@ -2796,7 +5885,7 @@ static void PutPageText() {
   ArrStrCatI32(&pagestr, app.pageSize, 10);
   ArrCat(&pagestr, 0);
   PutFt(DefFt(), 0xbebebe, 10, 10, pagestr);
-  RmArr(pagestr);
+  app.diagText = pagestr;
 }
 
 static void DiagImgAllocFrame() {
@@ -2804,18 +5893,17 @@ static void DiagImgAllocFrame() {
     ImgPage* page = &app.pages[app.diagPage];
     int i;
     /* black background */
-    Mesh mesh = MkMesh();
+    Mesh mesh = ScratchMesh();
     Col(mesh, 0x000000);
     Quad(mesh, 0, 0, app.pageSize + 10, app.pageSize + 40);
     PutMesh(mesh, 0, 0);
-    RmMesh(mesh);
     /* display entire page */
-    mesh = MkMesh();
+    mesh = ScratchMesh();
+    Col(mesh, 0xffffff);
     Quad(mesh, 10, 30, app.pageSize, app.pageSize);
     PutMeshRaw(mesh, 0, page->img);
-    RmMesh(mesh);
     /* rect packer region grid */
-    mesh = MkMesh();
+    mesh = ScratchMesh();
     Col(mesh, 0x00ff00);
     for (i = 0; i < ArrLen(page->pak->rects); ++i) {
       float* r = page->pak->rects[i].r;
@@ -2825,7 +5913,6 @@ static void DiagImgAllocFrame() {
       Quad(mesh, 10 + r[0], 30 + r[3], RectWidth(r), 1);
     }
     PutMeshRaw(mesh, 0, 0);
-    RmMesh(mesh);
   }
   PutPageText();
 }
@@ -2840,4 +5927,13 @@ void DiagImgAlloc(int enabled) {
   }
 }
 
+/* so the platform layer can define and use the real funcs */
+#ifdef WEEBCORE_MEMDIAG
+#undef Alloc
+#undef AllocRaw
+#undef AllocSz
+#undef AllocRawSz
+#undef ReallocSz
+#endif
+
 #endif /* WEEBCORE_IMPLEMENTATION */